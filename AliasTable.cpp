@@ -0,0 +1,78 @@
+#include "AliasTable.h"
+#include "LegalParams.h"
+#include <cmath>
+
+using std::vector;
+
+
+//Vose's method. Entries with non-positive values (unused indexes) can never be picked
+void AliasTable::build(const vector<OneComb>& probs)
+{
+	assert(probs.size() > 0);
+	const size_t n = probs.size();
+
+	sum = 0;
+	for (const auto& c : probs)
+		sum += std::max(c.val, 0.0);
+	assert(sum > 0);
+
+	vector<double> scaled(n);
+	vector<int> small, large;
+	small.reserve(n);
+	large.reserve(n);
+	for (size_t q = 0; q < n; q++)
+	{
+		scaled[q] = std::max(probs[q].val, 0.0) * n / sum;
+		if (scaled[q] < 1.0)
+			small.push_back(int(q));
+		else
+			large.push_back(int(q));
+	}
+
+	table.assign(n, AliasEntry());
+	auto toThreshold = [](double p)
+	{
+		return p >= 1.0 ? UINT64_MAX : uint64_t(std::ldexp(p, 64));
+	};
+
+	while (!small.empty() && !large.empty())
+	{
+		int s = small.back();
+		small.pop_back();
+		int l = large.back();
+
+		table[s].threshold = toThreshold(scaled[s]);
+		table[s].idx = probs[s].idx;
+		table[s].aliasIdx = probs[l].idx;
+
+		scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+		if (scaled[l] < 1.0)
+		{
+			large.pop_back();
+			small.push_back(l);
+		}
+	}
+
+	//Whatever is left is 1.0 up to rounding errors
+	for (const auto& rest : { large, small })
+	{
+		for (int q : rest)
+		{
+			table[q].threshold = UINT64_MAX;
+			table[q].idx = probs[q].idx;
+			table[q].aliasIdx = probs[q].idx;
+		}
+	}
+}
+
+
+size_t AliasTable::size() const
+{
+	return table.size();
+}
+
+
+double AliasTable::getSum() const
+{
+	return sum;
+}
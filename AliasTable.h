@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "misc.h"
+
+struct OneComb;
+
+
+struct AliasEntry
+{
+	uint64_t threshold = 0;					//Keep this column if the fractional part of the draw is below it, otherwise take the alias
+	int idx = -1;								//Value returned for this column
+	int aliasIdx = -1;						//Value returned for the alias of this column
+};
+
+
+//Walker/Vose alias table. Sampling from a discrete distribution is O(1) and touches a single 16-byte entry
+class AliasTable
+{
+private:
+	std::vector<AliasEntry> table;
+	double sum = 0;
+
+public:
+	void build(const std::vector<OneComb>& probs);
+	[[nodiscard]] size_t size() const;
+	[[nodiscard]] double getSum() const;
+
+	//One 64-bit random word picks both the column (high half of r * n) and the coin flip (low half of r * n)
+	[[nodiscard]] inline int pick(uint64_t r) const
+	{
+		const uint64_t n = table.size();
+		const AliasEntry& e = table[mul_hi64(r, n)];
+		return r * n < e.threshold ? e.idx : e.aliasIdx;
+	}
+};
@@ -0,0 +1,53 @@
+#include "AllocCounter.h"
+#include <cstdlib>
+#include <new>
+
+
+//A thread-local counter, so counting costs one increment and no synchronization. Over-aligned allocations go to the
+//standard library's aligned operator new and aren't counted
+static thread_local int64_t allocations = 0;
+
+
+int64_t threadAllocations()
+{
+	return allocations;
+}
+
+
+void* operator new(std::size_t size)
+{
+	allocations++;
+	if (void* p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+
+void* operator new[](std::size_t size)
+{
+	return operator new(size);
+}
+
+
+void operator delete(void* p) noexcept
+{
+	std::free(p);
+}
+
+
+void operator delete[](void* p) noexcept
+{
+	std::free(p);
+}
+
+
+void operator delete(void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
+
+
+void operator delete[](void* p, std::size_t) noexcept
+{
+	std::free(p);
+}
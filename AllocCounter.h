@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+
+//Heap allocations made by the calling thread so far. AllocCounter.cpp replaces the global operator new to count them
+[[nodiscard]] int64_t threadAllocations();
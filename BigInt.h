@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+//Unsigned integer of any size. Only what exact combination counts need: multiplication and exact division by small
+//numbers, addition, and conversion to double and decimal
+class BigInt
+{
+private:
+	std::vector<uint32_t> limbs;				//Least significant first, no leading zero limbs
+
+public:
+	BigInt(uint64_t v = 0)
+	{
+		for (; v; v >>= 32)
+			limbs.push_back(uint32_t(v));
+	}
+
+	[[nodiscard]] bool isZero() const
+	{
+		return limbs.empty();
+	}
+
+	BigInt& operator*=(uint32_t m)
+	{
+		uint64_t carry = 0;
+		for (auto& l : limbs)
+		{
+			const uint64_t v = uint64_t(l) * m + carry;
+			l = uint32_t(v);
+			carry = v >> 32;
+		}
+		if (carry)
+			limbs.push_back(uint32_t(carry));
+		if (m == 0)
+			limbs.clear();
+		return *this;
+	}
+
+	//Returns the remainder
+	uint32_t divide(uint32_t d)
+	{
+		uint64_t rem = 0;
+		for (size_t q = limbs.size(); q-- > 0; )
+		{
+			const uint64_t v = (rem << 32) | limbs[q];
+			limbs[q] = uint32_t(v / d);
+			rem = v % d;
+		}
+		while (!limbs.empty() && limbs.back() == 0)
+			limbs.pop_back();
+		return uint32_t(rem);
+	}
+
+	BigInt& operator+=(const BigInt& other)
+	{
+		limbs.resize(std::max(limbs.size(), other.limbs.size()), 0);
+		uint64_t carry = 0;
+		for (size_t q = 0; q < limbs.size(); q++)
+		{
+			const uint64_t v = uint64_t(limbs[q]) + (q < other.limbs.size() ? other.limbs[q] : 0) + carry;
+			limbs[q] = uint32_t(v);
+			carry = v >> 32;
+		}
+		if (carry)
+			limbs.push_back(uint32_t(carry));
+		return *this;
+	}
+
+	[[nodiscard]] double toDouble() const
+	{
+		double res = 0;
+		for (size_t q = limbs.size(); q-- > 0; )
+			res = res * 4294967296.0 + limbs[q];
+		return res;
+	}
+
+	[[nodiscard]] std::string toString() const
+	{
+		if (isZero())
+			return "0";
+		BigInt v = *this;
+		std::string res;
+		while (!v.isZero())
+			res += char('0' + v.divide(10));
+		std::reverse(res.begin(), res.end());
+		return res;
+	}
+};
@@ -0,0 +1,172 @@
+#include "Checkpoint.h"
+#include "FileSync.h"
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <type_traits>
+
+using std::vector;
+using std::cout;
+using std::endl;
+using std::string;
+
+static_assert(std::is_trivially_copyable_v<RandBuffer<bufferGen>>, "random buffers are saved as raw bytes");
+static_assert(std::is_trivially_copyable_v<randGen>, "random generators are saved as raw bytes");
+
+static const char CHECKPOINT_MAGIC[8] = { 'C', 'C', 'C', 'K', 'P', 'T', '0', '7' };
+
+
+Checkpoint::Checkpoint(int nthreads, size_t nopenings, size_t nprofiles) : threads(nthreads)
+{
+	for (auto& t : threads)
+		t.stats.setSizes(nopenings, nprofiles);
+}
+
+
+void Checkpoint::snapshot(int tnum, const EstimateStats& st, const LegalParams& lp, int64_t req)
+{
+	ThreadSnapshot& t = threads[tnum];
+	t.stats = st;
+	t.rules = lp.ruleStats[tnum];
+	t.rbuf = lp.rbufs[tnum];
+	t.rgen = lp.rgensPCG[tnum];
+	t.epoch.store(req, std::memory_order_release);
+}
+
+
+bool Checkpoint::collect(const std::atomic<bool>& stop)
+{
+	const int64_t req = requested.fetch_add(1) + 1;
+	for (const auto& t : threads)
+	{
+		while (t.epoch.load(std::memory_order_acquire) != req)
+		{
+			if (stop)
+				return false;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+	return true;
+}
+
+
+void Checkpoint::collectStopped(const vector<EstimateStats>& stats, const LegalParams& lp)
+{
+	const int64_t req = requested.fetch_add(1) + 1;
+	for (int t = 0; t < int(threads.size()); t++)
+		snapshot(t, stats[t], lp, req);
+}
+
+
+template<typename T>
+static void writeRaw(std::ofstream& f, const T& v)
+{
+	f.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+
+template<typename T>
+static void readRaw(std::ifstream& f, T& v)
+{
+	f.read(reinterpret_cast<char*>(&v), sizeof(T));
+}
+
+
+//Header with --reproducible, --stratified and the names of the restriction profiles, then per thread: estimate counters, rule counters, rule order, random buffer, PCG generator. Then the magic again
+bool Checkpoint::save(const string& fname, ESampleType sampleType, const string& profile, int shard, bool reproducible, bool stratified) const
+{
+	const string tmpName = fname + ".tmp";
+	{
+		std::ofstream f(tmpName, std::ios::binary | std::ios::trunc);
+		f.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+		writeRaw(f, int32_t(sampleType));
+		writeRaw(f, int32_t(shard));
+		writeRaw(f, int32_t(reproducible));
+		writeRaw(f, int32_t(stratified));
+		writeRaw(f, int32_t(threads.size()));
+		writeRaw(f, int32_t(threads[0].stats.nopenings));
+		writeRaw(f, int32_t(profile.size()));
+		f.write(profile.data(), profile.size());
+
+		auto writeCounter = [&](const auto& c) { writeRaw(f, c.get()); };
+		for (const auto& t : threads)
+		{
+			EstimateStats::forEachCounter(t.stats, writeCounter);
+			RuleStats::forEachCounter(t.rules, writeCounter);
+			for (const auto& r : t.rules.order)
+				writeRaw(f, int32_t(r.get()));
+			writeRaw(f, t.rbuf);
+			writeRaw(f, t.rgen);
+		}
+		f.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+		f.close();			//The last block is only written here, so the check must come after
+		if (!f)
+		{
+			cout << "Could not write checkpoint " << tmpName << endl;
+			std::error_code ec;
+			std::filesystem::remove(tmpName, ec);
+			return false;
+		}
+	}
+
+	return replaceFile(tmpName, fname);
+}
+
+
+bool Checkpoint::load(const string& fname, ESampleType sampleType, bool stratified, vector<EstimateStats>& stats, LegalParams& lp)
+{
+	std::ifstream f(fname, std::ios::binary);
+	char magic[sizeof(CHECKPOINT_MAGIC)];
+	int32_t savedType = -1, shard = -1, reproducible = -1, savedStratified = -1, nthreads = -1, nopenings = -1;
+	f.read(magic, sizeof(magic));
+	readRaw(f, savedType);
+	readRaw(f, shard);
+	readRaw(f, reproducible);
+	readRaw(f, savedStratified);
+	readRaw(f, nthreads);
+	readRaw(f, nopenings);
+	int32_t profileSize = -1;
+	readRaw(f, profileSize);
+	if (!f || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 || profileSize < 0 || profileSize > 4096)
+	{
+		cout << "Not a checkpoint: " << fname << endl;
+		return false;
+	}
+	string profile(profileSize, ' ');
+	f.read(profile.data(), profileSize);
+	if (savedType != int32_t(sampleType) || shard != lp.shard || reproducible != int32_t(lp.reproducible) || savedStratified != int32_t(stratified) || nthreads != int32_t(stats.size()) || nopenings != int32_t(stats[0].nopenings)
+		|| profile != lp.profilesName())
+	{
+		cout << "Checkpoint " << fname << " was made with a different sample type, profile, shard, --reproducible, --stratified, thread count or opening list" << endl;
+		return false;
+	}
+
+	auto readCounter = [&](auto& c)
+	{
+		decltype(c.get()) v{};
+		readRaw(f, v);
+		c.set(v);
+	};
+	for (int t = 0; t < nthreads; t++)
+	{
+		EstimateStats::forEachCounter(stats[t], readCounter);
+		RuleStats::forEachCounter(lp.ruleStats[t], readCounter);
+		for (auto& r : lp.ruleStats[t].order)
+		{
+			int32_t v = 0;
+			readRaw(f, v);
+			r.set(ERule(v));
+		}
+		readRaw(f, lp.rbufs[t]);
+		readRaw(f, lp.rgensPCG[t]);
+	}
+	f.read(magic, sizeof(magic));
+	if (!f || std::memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0)
+	{
+		cout << "Truncated checkpoint: " << fname << endl;
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "EstimateStats.h"
+#include "LegalChecker.h"
+#include "LegalParams.h"
+
+
+//State of one worker at a sample boundary: everything needed to continue its random stream exactly
+struct alignas(64) ThreadSnapshot
+{
+	std::atomic<int64_t> epoch = 0;			//Last checkpoint request this snapshot answers
+	EstimateStats stats;
+	RuleStats rules;
+	RandBuffer<bufferGen> rbuf;
+	randGen rgen;
+};
+
+
+//Periodic checkpoints of posEstimate. The reporter thread requests a snapshot, every worker copies its own state
+//at its next sample boundary (a few KB, no locks), and the reporter writes them to a temp file and renames it
+class Checkpoint
+{
+private:
+	std::vector<ThreadSnapshot> threads;
+	std::atomic<int64_t> requested = 0;		//Incremented for every checkpoint
+
+public:
+	Checkpoint(int nthreads, size_t nopenings, size_t nprofiles);
+
+	//Called by worker tnum between samples. A single relaxed load unless a checkpoint was requested
+	inline void poll(int tnum, const EstimateStats& st, const LegalParams& lp)
+	{
+		const int64_t req = requested.load(std::memory_order_relaxed);
+		if (req != threads[tnum].epoch.load(std::memory_order_relaxed))
+			snapshot(tnum, st, lp, req);
+	}
+
+	void snapshot(int tnum, const EstimateStats& st, const LegalParams& lp, int64_t req);
+
+	//Called by the reporter. Waits (without blocking the workers) until all of them have answered.
+	//Returns false if stop was set first
+	[[nodiscard]] bool collect(const std::atomic<bool>& stop);
+
+	//Only after the workers stopped
+	void collectStopped(const std::vector<EstimateStats>& stats, const LegalParams& lp);
+
+	[[nodiscard]] bool save(const std::string& fname, ESampleType sampleType, const std::string& profile, int shard, bool reproducible, bool stratified) const;
+	[[nodiscard]] static bool load(const std::string& fname, ESampleType sampleType, bool stratified, std::vector<EstimateStats>& stats, LegalParams& lp);
+};
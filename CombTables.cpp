@@ -0,0 +1,319 @@
+#include "CombTables.h"
+#include "FileSync.h"
+#include "LegalParams.h"
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using std::vector;
+using std::cout;
+using std::endl;
+using std::string;
+
+static const char COMB_CACHE_MAGIC[8] = { 'C', 'C', 'C', 'O', 'M', 'B', '0', '3' };
+static const int FREE_SQUARES = 62;			//Squares not taken by the kings
+
+
+PieceCaps::PieceCaps(const std::array<int, PK_NB>& maxCountIn, int maxQueensTotalIn) : maxCount(maxCountIn), maxQueensTotal(maxQueensTotalIn)
+{
+	for (int slot = 0; slot < 2 * PK_NB; slot++)
+	{
+		radix[slot] = uint32_t(maxCount[slot / 2] + 1);
+		reciprocal[slot] = ((uint64_t(1) << 40) + radix[slot] - 1) / radix[slot];
+	}
+	assert(size() <= MAX_SIZE);
+}
+
+
+int64_t PieceCaps::size() const
+{
+	int64_t res = 1;
+	for (uint32_t r : radix)
+		res *= r;
+	return res;
+}
+
+
+int PieceCaps::encode(const std::array<int, 2 * PK_NB>& counts) const
+{
+	int idx = 0;
+	for (int slot = 0; slot < 2 * PK_NB; slot++)
+		idx = idx * int(radix[slot]) + counts[slot];
+	return idx;
+}
+
+
+//For example P8N2B2R2Q3, or P8N2B2R2Q3T4 with at most 4 queens in total
+string PieceCaps::name() const
+{
+	string res;
+	for (int k = 0; k < PK_NB; k++)
+		res += string(1, "PNBRQ"[k]) + std::to_string(maxCount[k]);
+	if (maxQueensTotal >= 0)
+		res += "T" + std::to_string(maxQueensTotal);
+	return res;
+}
+
+
+bool PieceCaps::operator==(const PieceCaps& other) const
+{
+	return maxCount == other.maxCount && maxQueensTotal == other.maxQueensTotal;
+}
+
+
+//Is every combination within these caps also within other?
+bool PieceCaps::within(const PieceCaps& other) const
+{
+	for (int k = 0; k < PK_NB; k++)
+		if (maxCount[k] > other.maxCount[k])
+			return false;
+	const int queensTotal = maxQueensTotal >= 0 ? maxQueensTotal : 2 * maxCount[PK_QUEEN];
+	return other.maxQueensTotal < 0 || queensTotal <= other.maxQueensTotal;
+}
+
+
+//C(62, p) * 10^p: p pieces on 62 squares, each one of the 10 non-king pieces
+CombTable piecesTable()
+{
+	CombTable t;
+	BigInt binom = 1;
+	for (int p = 0; p <= PieceCaps::MAX_TOTAL; p++)
+	{
+		BigInt x = binom;
+		for (int q = 0; q < p; q++)
+			x *= 10;
+		t.combs.push_back({ p, x.toDouble() });
+		t.sum += x;
+		binom *= FREE_SQUARES - p;
+		binom.divide(p + 1);
+	}
+	return t;
+}
+
+
+//C(62, w) * C(62 - w, b) * 5^(w + b): w white and b black pieces, each one of the 5 non-king pieces of its side
+CombTable piecesWBTable()
+{
+	CombTable t;
+	BigInt binomW = 1;
+	for (int w = 0; w <= PieceCaps::MAX_PER_SIDE; w++)
+	{
+		BigInt binomWB = binomW;
+		for (int b = 0; b <= PieceCaps::MAX_PER_SIDE; b++)
+		{
+			BigInt x = binomWB;
+			for (int q = 0; q < w + b; q++)
+				x *= 5;
+			t.combs.push_back({ w * 16 + b, x.toDouble() });
+			t.sum += x;
+			binomWB *= FREE_SQUARES - w - b;
+			binomWB.divide(b + 1);
+		}
+		binomW *= FREE_SQUARES - w;
+		binomW.divide(w + 1);
+	}
+	return t;
+}
+
+
+//Every combination of piece counts within the caps, at most MAX_PER_SIDE pieces per side and MAX_TOTAL in total. Each
+//is the multinomial C(62, wp) * C(62 - wp, bp) * ... * C(62 - ... - wq, bq), built one binomial per slot
+CombTable restrictedTable(const PieceCaps& caps)
+{
+	CombTable t;
+	std::array<int, 2 * PK_NB> counts = {};
+
+	auto addSlot = [&](auto&& self, int slot, const BigInt& ways, int used, int usedWhite, int usedBlack) -> void
+	{
+		if (slot == 2 * PK_NB)
+		{
+			t.combs.push_back({ caps.encode(counts), ways.toDouble() });
+			t.sum += ways;
+			return;
+		}
+
+		const bool white = slot % 2 == 0;
+		int maxHere = std::min({ caps.maxCount[slot / 2], PieceCaps::MAX_PER_SIDE - (white ? usedWhite : usedBlack),
+			PieceCaps::MAX_TOTAL - used });
+		if (slot == 2 * PK_QUEEN + 1 && caps.maxQueensTotal >= 0)
+			maxHere = std::min(maxHere, caps.maxQueensTotal - counts[2 * PK_QUEEN]);
+		BigInt x = ways;
+		for (int c = 0; c <= maxHere; c++)
+		{
+			counts[slot] = c;
+			self(self, slot + 1, x, used + c, usedWhite + (white ? c : 0), usedBlack + (white ? 0 : c));
+			x *= FREE_SQUARES - used - c;
+			x.divide(c + 1);
+		}
+		counts[slot] = 0;
+	};
+	addSlot(addSlot, 0, BigInt(1), 0, 0, 0);
+	return t;
+}
+
+
+template<typename T>
+static void writeRaw(std::ofstream& f, const T& v)
+{
+	f.write(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+template<typename T>
+static void readRaw(std::ifstream& f, T& v)
+{
+	f.read(reinterpret_cast<char*>(&v), sizeof(T));
+}
+
+
+//FNV-1a, continued from h over more bytes. The cache ends with it, so that a damaged or edited file is generated again
+static uint64_t checksum(uint64_t h, const void* data, size_t bytes)
+{
+	const unsigned char* p = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < bytes; i++)
+		h = (h ^ p[i]) * 0x100000001b3ull;
+	return h;
+}
+
+static const uint64_t CHECKSUM_START = 0xcbf29ce484222325ull;
+
+
+//False unless the file is complete and its checksum, indices, piece counts and sum are consistent
+static bool loadCache(const string& fname, const PieceCaps& caps, CombTable& t)
+{
+	std::ifstream f(fname, std::ios::binary);
+	if (!f)
+		return false;
+
+	uint64_t hash = CHECKSUM_START;
+	auto get = [&](auto& v)
+	{
+		f.read(reinterpret_cast<char*>(&v), sizeof(v));
+		hash = checksum(hash, &v, sizeof(v));
+	};
+	char magic[sizeof(COMB_CACHE_MAGIC)];
+	f.read(magic, sizeof(magic));
+	std::array<int32_t, PK_NB> savedCaps;
+	for (auto& c : savedCaps)
+		get(c);
+	int32_t savedQueensTotal = -2;
+	get(savedQueensTotal);
+	int64_t n = -1;
+	get(n);
+	if (!f || std::memcmp(magic, COMB_CACHE_MAGIC, sizeof(magic)) != 0 || !std::equal(savedCaps.begin(), savedCaps.end(), caps.maxCount.begin())
+		|| savedQueensTotal != caps.maxQueensTotal || n <= 0 || n > caps.size())
+		return false;
+
+	t.combs.resize(n);
+	for (auto& c : t.combs)
+	{
+		int32_t idx = -1;
+		get(idx);
+		get(c.val);
+		c.idx = idx;
+	}
+	int32_t sumDigits = -1;
+	get(sumDigits);
+	if (!f || sumDigits <= 0 || sumDigits > 1000)
+		return false;
+	string digits(sumDigits, '0');
+	f.read(digits.data(), sumDigits);
+	hash = checksum(hash, digits.data(), digits.size());
+	uint64_t savedHash = 0;
+	readRaw(f, savedHash);
+	f.read(magic, sizeof(magic));
+	if (!f || savedHash != hash || std::memcmp(magic, COMB_CACHE_MAGIC, sizeof(magic)) != 0)
+		return false;
+
+	//Every combination once, within the caps and the per-side and total limits, with a positive number of ways
+	vector<bool> seen(size_t(caps.size()), false);
+	double valSum = 0;
+	for (const auto& c : t.combs)
+	{
+		if (c.idx < 0 || c.idx >= caps.size() || seen[c.idx] || !(c.val > 0) || !std::isfinite(c.val))
+			return false;
+		seen[c.idx] = true;
+		const auto counts = caps.decode(c.idx);
+		int white = 0, black = 0;
+		for (int slot = 0; slot < 2 * PK_NB; slot++)
+		{
+			if (counts[slot] > caps.maxCount[slot / 2])
+				return false;
+			(slot % 2 == 0 ? white : black) += counts[slot];
+		}
+		if (white > PieceCaps::MAX_PER_SIDE || black > PieceCaps::MAX_PER_SIDE || white + black > PieceCaps::MAX_TOTAL
+			|| (caps.maxQueensTotal >= 0 && counts[2 * PK_QUEEN] + counts[2 * PK_QUEEN + 1] > caps.maxQueensTotal))
+			return false;
+		valSum += c.val;
+	}
+
+	t.sum = 0;
+	for (char d : digits)
+	{
+		if (d < '0' || d > '9')
+			return false;
+		t.sum *= 10;
+		t.sum += BigInt(uint64_t(d - '0'));
+	}
+	//The ways of each combination are rounded to double, so their sum only agrees to about n ulps
+	return std::abs(t.sum.toDouble() - valSum) <= 1e-9 * valSum;
+}
+
+
+static void saveCache(const string& fname, const PieceCaps& caps, const CombTable& t)
+{
+	const string tmpName = fname + ".tmp";
+	{
+		std::ofstream f(tmpName, std::ios::binary | std::ios::trunc);
+		uint64_t hash = CHECKSUM_START;
+		auto put = [&](const auto& v)
+		{
+			f.write(reinterpret_cast<const char*>(&v), sizeof(v));
+			hash = checksum(hash, &v, sizeof(v));
+		};
+		f.write(COMB_CACHE_MAGIC, sizeof(COMB_CACHE_MAGIC));
+		for (int c : caps.maxCount)
+			put(int32_t(c));
+		put(int32_t(caps.maxQueensTotal));
+		put(int64_t(t.combs.size()));
+		for (const auto& c : t.combs)
+		{
+			put(int32_t(c.idx));
+			put(c.val);
+		}
+		const string digits = t.sum.toString();
+		put(int32_t(digits.size()));
+		f.write(digits.data(), digits.size());
+		hash = checksum(hash, digits.data(), digits.size());
+		writeRaw(f, hash);
+		f.write(COMB_CACHE_MAGIC, sizeof(COMB_CACHE_MAGIC));
+		f.close();			//The last block is only written here, so the check must come after
+		if (!f)
+		{
+			cout << "Could not write " << tmpName << endl;
+			std::error_code ec;
+			std::filesystem::remove(tmpName, ec);
+			return;
+		}
+	}
+
+	(void)replaceFile(tmpName, fname);			//Without the cache the table is just generated again next time
+}
+
+
+//restrictedTable, from combinations-<caps>.bin in the working directory if it is there. Otherwise generated and saved there
+CombTable cachedRestrictedTable(const PieceCaps& caps)
+{
+	const string fname = "combinations-" + caps.name() + ".bin";
+	CombTable t;
+	if (loadCache(fname, caps, t))
+		return t;
+	if (std::filesystem::exists(fname))
+		cout << "Damaged or outdated " << fname << ", generating it again" << endl;
+
+	t = restrictedTable(caps);
+	saveCache(fname, caps, t);
+	return t;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "BigInt.h"
+
+struct OneComb;
+
+enum EPieceKind { PK_PAWN, PK_KNIGHT, PK_BISHOP, PK_ROOK, PK_QUEEN, PK_NB };
+
+
+//Most pieces of each kind per side, for the combination tables of the restricted sample types. The index of a combination
+//is mixed radix over [wp, bp, wn, bn, wb, bb, wr, br, wq, bq], wp most significant
+struct PieceCaps
+{
+	std::array<int, PK_NB> maxCount;
+	int maxQueensTotal = -1;							//Most queens of both sides together, -1 if only maxCount limits them
+	std::array<uint32_t, 2 * PK_NB> radix;				//maxCount + 1 of each slot
+	std::array<uint64_t, 2 * PK_NB> reciprocal;		//ceil(2^40 / radix): decode() runs once per sample, without divisions
+
+	static constexpr int MAX_PER_SIDE = 15;		//Non-king pieces of one side
+	static constexpr int MAX_TOTAL = 30;			//Non-king pieces of both sides
+
+	static constexpr int64_t MAX_SIZE = 1 << 24;	//Most combinations decode() is exact for
+
+	PieceCaps(const std::array<int, PK_NB>& maxCountIn = { 8, 2, 2, 2, 3 }, int maxQueensTotalIn = -1);
+	[[nodiscard]] int64_t size() const;
+	[[nodiscard]] int encode(const std::array<int, 2 * PK_NB>& counts) const;
+	[[nodiscard]] std::string name() const;
+	[[nodiscard]] bool operator==(const PieceCaps& other) const;
+	[[nodiscard]] bool within(const PieceCaps& other) const;
+
+	//Returns [wp, bp, wn, bn, wb, bb, wr, br, wq, bq]. Exact for idx < MAX_SIZE
+	[[nodiscard]] inline std::array<int, 2 * PK_NB> decode(int idx) const
+	{
+		std::array<int, 2 * PK_NB> counts;
+		uint64_t v = uint64_t(idx);
+		for (int slot = 2 * PK_NB - 1; slot >= 0; slot--)
+		{
+			const uint64_t quot = (v * reciprocal[slot]) >> 40;
+			counts[slot] = int(v - quot * radix[slot]);
+			v = quot;
+		}
+		return counts;
+	}
+};
+
+
+//Number of ways to put the pieces of each combination on the 62 squares not taken by the kings, and their exact sum
+struct CombTable
+{
+	std::vector<OneComb> combs;
+	BigInt sum;
+};
+
+
+[[nodiscard]] CombTable piecesTable();
+[[nodiscard]] CombTable piecesWBTable();
+[[nodiscard]] CombTable restrictedTable(const PieceCaps& caps);
+[[nodiscard]] CombTable cachedRestrictedTable(const PieceCaps& caps);
@@ -0,0 +1,175 @@
+#include "Counts.h"
+#include "FileSync.h"
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <sstream>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+static const string COUNTS_HEADER = "ChessCounter counts 2";
+
+
+//One "key values" line per counter. Opening names come last on their lines because they contain spaces
+bool EstimateCounts::save(const string& fname) const
+{
+	const string tmpName = fname + ".tmp";
+	{
+		std::ofstream f(tmpName, std::ios::trunc);
+		f.precision(std::numeric_limits<double>::max_digits10);
+		f << COUNTS_HEADER << '\n';
+		f << "sampleType " << sampleType << '\n';
+		f << "profile " << profile << '\n';
+		f << "shard " << shard << ' ' << shards << '\n';
+		f << "samples " << samples << '\n';
+		f << "legalHits " << legalHits << '\n';
+		f << "totalPossibilities " << totalPossibilities << '\n';
+		f << "legal " << legal << ' ' << legalSq << '\n';
+		f << "legalRestricted " << legalRestricted << ' ' << legalRestrictedSq << '\n';
+		for (int q = 0; q < int(byCount.size()); q++)
+			f << "byCount " << q << ' ' << byCount[q] << ' ' << byCountSq[q] << ' ' << byCountRestricted[q] << ' ' << byCountRestrictedSq[q] << '\n';
+		for (size_t c = 0; c < openings.size(); c++)
+			f << "opening " << openings[c] << ' ' << openingsSq[c] << ' ' << openingNames[c] << '\n';
+		for (size_t c = 0; c < profiles.size(); c++)
+			f << "extraProfile " << profiles[c] << ' ' << profilesSq[c] << ' ' << profileNames[c] << '\n';
+		f.close();			//Nothing may reach the file before this, so only now can a write error show
+		if (!f)
+		{
+			cout << "Could not write " << tmpName << endl;
+			std::error_code ec;
+			std::filesystem::remove(tmpName, ec);
+			return false;
+		}
+	}
+
+	return replaceFile(tmpName, fname);
+}
+
+
+bool EstimateCounts::load(const string& fname)
+{
+	std::ifstream f(fname);
+	string line;
+	if (!std::getline(f, line) || line != COUNTS_HEADER)
+	{
+		cout << "Not a counts file: " << fname << endl;
+		return false;
+	}
+
+	*this = EstimateCounts();
+	string key;
+	while (f >> key)
+	{
+		if (key == "sampleType")
+			f >> sampleType;
+		else if (key == "profile")
+			f >> profile;
+		else if (key == "shard")
+			f >> shard >> shards;
+		else if (key == "samples")
+			f >> samples;
+		else if (key == "legalHits")
+			f >> legalHits;
+		else if (key == "totalPossibilities")
+			f >> totalPossibilities;
+		else if (key == "legal")
+			f >> legal >> legalSq;
+		else if (key == "legalRestricted")
+			f >> legalRestricted >> legalRestrictedSq;
+		else if (key == "byCount")
+		{
+			int q = 0;
+			f >> q;
+			f >> byCount.at(q) >> byCountSq.at(q) >> byCountRestricted.at(q) >> byCountRestrictedSq.at(q);
+		}
+		else if (key == "opening")
+		{
+			double count = 0, countSq = 0;
+			string name;
+			f >> count >> countSq;
+			std::getline(f >> std::ws, name);
+			openingNames.push_back(name);
+			openings.push_back(count);
+			openingsSq.push_back(countSq);
+		}
+		else if (key == "extraProfile")
+		{
+			double count = 0, countSq = 0;
+			string name;
+			f >> count >> countSq >> name;
+			profileNames.push_back(name);
+			profiles.push_back(count);
+			profilesSq.push_back(countSq);
+		}
+		else
+		{
+			cout << "Unknown entry " << key << " in " << fname << endl;
+			return false;
+		}
+	}
+	return !f.bad();
+}
+
+
+//Fails if the counts aren't from the same kind of estimate
+bool EstimateCounts::add(const EstimateCounts& other)
+{
+	if (samples == 0)
+	{
+		*this = other;
+		return true;
+	}
+
+	if (other.sampleType != sampleType || other.profile != profile || other.totalPossibilities != totalPossibilities || other.openingNames != openingNames || other.profileNames != profileNames)
+		return false;
+
+	samples += other.samples;
+	legalHits += other.legalHits;
+	legal += other.legal;
+	legalSq += other.legalSq;
+	legalRestricted += other.legalRestricted;
+	legalRestrictedSq += other.legalRestrictedSq;
+	for (int q = 0; q < int(byCount.size()); q++)
+	{
+		byCount[q] += other.byCount[q];
+		byCountSq[q] += other.byCountSq[q];
+		byCountRestricted[q] += other.byCountRestricted[q];
+		byCountRestrictedSq[q] += other.byCountRestrictedSq[q];
+	}
+	for (size_t c = 0; c < openings.size(); c++)
+	{
+		openings[c] += other.openings[c];
+		openingsSq[c] += other.openingsSq[c];
+	}
+	for (size_t c = 0; c < profiles.size(); c++)
+	{
+		profiles[c] += other.profiles[c];
+		profilesSq[c] += other.profilesSq[c];
+	}
+	return true;
+}
+
+
+//Every sample contributes x (0 if illegal) and the estimate is mean(x) * totalPossibilities
+std::pair<double, double> EstimateCounts::estimate(double sum, double sumSq) const
+{
+	if (samples < 2)
+		return { 0, 0 };
+	const double n = double(samples);
+	const double mean = sum / n;
+	const double variance = std::max(0.0, (sumSq - n * mean * mean) / (n - 1));
+	return { mean * totalPossibilities, std::sqrt(variance / n) * totalPossibilities };
+}
+
+
+std::string formatEstimate(std::pair<double, double> estimate)
+{
+	const auto [est, se] = estimate;
+	std::ostringstream ss;
+	ss << est << " +- " << se << " [" << est - 1.96 * se << ", " << est + 1.96 * se << "]";
+	return ss.str();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+//Totals of one posEstimate run (one shard), as written to the --counts file. Shards of the same estimate are merged
+//by adding their counts, and the standard errors follow from the pooled sums of squares
+struct EstimateCounts
+{
+	std::string sampleType;
+	std::string profile;							//Name of the restriction profile legalRestricted counts
+	int shard = 0;
+	int shards = 1;
+	int64_t samples = 0;
+	int64_t legalHits = 0;
+	double totalPossibilities = 0;
+	double legal = 0;
+	double legalSq = 0;
+	double legalRestricted = 0;
+	double legalRestrictedSq = 0;
+	std::array<double, 33> byCount{};
+	std::array<double, 33> byCountRestricted{};
+	std::array<double, 33> byCountSq{};
+	std::array<double, 33> byCountRestrictedSq{};
+	std::vector<std::string> openingNames;
+	std::vector<double> openings;
+	std::vector<double> openingsSq;
+	std::vector<std::string> profileNames;	//--profiles
+	std::vector<double> profiles;
+	std::vector<double> profilesSq;
+
+	[[nodiscard]] bool save(const std::string& fname) const;
+	[[nodiscard]] bool load(const std::string& fname);
+	[[nodiscard]] bool add(const EstimateCounts& other);
+
+	//Estimated number of positions for a weighted count and its sum of squares, with the standard error of the mean
+	[[nodiscard]] std::pair<double, double> estimate(double sum, double sumSq) const;
+};
+
+
+//"estimate +- standard error [95% confidence interval]"
+[[nodiscard]] std::string formatEstimate(std::pair<double, double> estimate);
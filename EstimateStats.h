@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include "types.h"
+#include "RelaxedAtomic.h"
+#include "Strata.h"
+
+
+//Counters of one posEstimate worker thread. Each block starts on its own page, so that workers never write to a line
+//another worker uses and --numa can move a worker's counters to its node without a neighbor's. The reporter thread
+//reads them while the workers keep going. Every counter is inside the block, none on the heap
+struct alignas(4096) EstimateStats
+{
+	static constexpr size_t MAX_OPENINGS = 16;
+	static constexpr size_t MAX_PROFILES = 16;								//--profiles
+
+	RelaxedAtomic<int64_t> all;													//Samples drawn
+	RelaxedAtomic<int64_t> legalHits;											//Samples that were legal
+	RelaxedAtomic<double> legal;												//Weighted legal positions
+	RelaxedAtomic<double> legalRestricted;									//Weighted legal positions that also pass the restricted rules
+	RelaxedAtomic<double> legalSq;												//Sum of squared per-sample legal weights, for the standard error
+	RelaxedAtomic<double> legalRestrictedSq;								//Same for legalRestricted
+	std::array<RelaxedAtomic<double>, 33> byCount;							//legal by total number of pieces
+	std::array<RelaxedAtomic<double>, 33> byCountRestricted;				//legalRestricted by total number of pieces
+	std::array<RelaxedAtomic<double>, 33> byCountSq;						//Sums of squared per-sample weights of byCount
+	std::array<RelaxedAtomic<double>, 33> byCountRestrictedSq;			//Same for byCountRestricted
+	std::array<RelaxedAtomic<double>, SQUARE_NB> kingSquares;			//Legal positions with a king on each square
+	std::array<RelaxedAtomic<double>, 3> kingIn;							//Legal positions by number of kings in pawn squares
+	std::array<std::array<RelaxedAtomic<double>, 16>, PIECE_NB> pieceCounts;	//Legal positions by count of each piece
+	std::array<RelaxedAtomic<double>, MAX_OPENINGS> openings;			//Legal positions compatible with each opening
+	std::array<RelaxedAtomic<double>, MAX_OPENINGS> openingsSq;			//Sums of squared per-sample weights of openings
+	std::array<RelaxedAtomic<double>, MAX_PROFILES> profiles;			//--profiles: weighted legal positions within each extra restriction profile
+	std::array<RelaxedAtomic<double>, MAX_PROFILES> profilesSq;			//Sums of squared per-sample weights of profiles
+	size_t nopenings = 0;														//How many of openings are used
+	size_t nprofiles = 0;														//How many of profiles are used
+	std::array<RelaxedAtomic<double>, NUM_STRATA> stratumSamples;		//--stratified: samples drawn from each stratum
+	std::array<RelaxedAtomic<double>, NUM_STRATA> stratumSum;				//Unweighted legalRestricted of each stratum
+	std::array<RelaxedAtomic<double>, NUM_STRATA> stratumSumSq;			//Sums of its squared per-sample values
+	std::array<RelaxedAtomic<double>, NUM_STRATA> stratumCycles;			//Time spent on each stratum
+	std::array<RelaxedAtomic<double>, NUM_STRATA> stratumAlloc;			//This thread's current probability of drawing each stratum
+
+	//The counters whose number depends on the run. The caller checks the maximums
+	void setSizes(size_t nopeningsIn, size_t nprofilesIn)
+	{
+		assert(nopeningsIn <= MAX_OPENINGS && nprofilesIn <= MAX_PROFILES);
+		nopenings = nopeningsIn;
+		nprofiles = nprofilesIn;
+	}
+
+	//Calls f on every counter, always in the same order. For checkpoints
+	template<typename TStats, typename F>
+	static void forEachCounter(TStats& st, F&& f)
+	{
+		f(st.all);
+		f(st.legalHits);
+		f(st.legal);
+		f(st.legalRestricted);
+		f(st.legalSq);
+		f(st.legalRestrictedSq);
+		for (auto& c : st.byCount)
+			f(c);
+		for (auto& c : st.byCountRestricted)
+			f(c);
+		for (auto& c : st.byCountSq)
+			f(c);
+		for (auto& c : st.byCountRestrictedSq)
+			f(c);
+		for (auto& c : st.kingSquares)
+			f(c);
+		for (auto& c : st.kingIn)
+			f(c);
+		for (auto& pc : st.pieceCounts)
+			for (auto& c : pc)
+				f(c);
+		for (size_t c = 0; c < st.nopenings; c++)
+			f(st.openings[c]);
+		for (size_t c = 0; c < st.nopenings; c++)
+			f(st.openingsSq[c]);
+		for (size_t c = 0; c < st.nprofiles; c++)
+			f(st.profiles[c]);
+		for (size_t c = 0; c < st.nprofiles; c++)
+			f(st.profilesSq[c]);
+		for (auto* arr : { &st.stratumSamples, &st.stratumSum, &st.stratumSumSq, &st.stratumCycles, &st.stratumAlloc })
+			for (auto& c : *arr)
+				f(c);
+	}
+};
@@ -0,0 +1,59 @@
+#include "FileSync.h"
+#include <filesystem>
+#include <iostream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using std::cout;
+using std::endl;
+using std::string;
+
+
+bool syncToDisk(const string& path, bool directory)
+{
+#ifdef _WIN32
+	if (directory)
+		return true;
+	const HANDLE h = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (h == INVALID_HANDLE_VALUE)
+		return false;
+	const bool ok = FlushFileBuffers(h) != 0;
+	CloseHandle(h);
+	return ok;
+#else
+	const int fd = ::open(path.c_str(), directory ? O_RDONLY | O_DIRECTORY : O_WRONLY);
+	if (fd < 0)
+		return false;
+	const bool ok = fsync(fd) == 0;
+	::close(fd);
+	return ok;
+#endif
+}
+
+
+bool replaceFile(const string& tmpName, const string& fname)
+{
+	std::error_code ec;
+	if (!syncToDisk(tmpName, false))
+	{
+		cout << "Could not write " << tmpName << endl;
+		std::filesystem::remove(tmpName, ec);
+		return false;
+	}
+	std::filesystem::rename(tmpName, fname, ec);		//Atomic
+	if (ec)
+	{
+		cout << "Could not rename " << tmpName << " to " << fname << ": " << ec.message() << endl;
+		return false;
+	}
+	//The rename itself only lasts once the directory is on the disk
+	const std::filesystem::path dir = std::filesystem::absolute(fname, ec).parent_path();
+	if (ec || !syncToDisk(dir.string(), true))
+		cout << "Could not sync the directory of " << fname << endl;
+	return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+
+//Flushes a written file, or with a directory its entries, to the disk, so that they survive a crash of the machine.
+//Directories can't be opened for this on Windows, where renames are journaled anyway
+[[nodiscard]] bool syncToDisk(const std::string& path, bool directory);
+//Puts the closed and checked tmpName in place of fname: readers see the old or the new file, never a partial one, and
+//after a crash the new one is there if this returned true. Says what failed, and removes tmpName if it wasn't written
+[[nodiscard]] bool replaceFile(const std::string& tmpName, const std::string& fname);
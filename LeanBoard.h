@@ -0,0 +1,56 @@
+#pragma once
+
+#include <array>
+#include "position.h"
+
+
+//Just enough of a board for the legality checks: a mailbox and per-piece bitboards.
+//Setting it up is a few stores per piece, unlike Position::setMine which also computes keys, check info and NNUE state
+struct LeanBoard
+{
+	std::array<Piece, SQUARE_NB> board;			//What is on each square
+	std::array<Bitboard, PIECE_NB> byPiece;		//Where each piece type is
+	std::array<Bitboard, COLOR_NB> byColor;		//All white and all black pieces
+	Bitboard occupied = 0;							//All pieces
+
+	LeanBoard()
+	{
+		board.fill(NO_PIECE);
+		byPiece.fill(0);
+		byColor.fill(0);
+	}
+
+	template<size_t N>
+	inline void set(int ntotal, const std::array<Piece, N>& pieces, const std::array<Square, N>& squares)
+	{
+		//Only the previously occupied squares need clearing
+		for (Bitboard b = occupied; b; )
+			board[pop_lsb(&b)] = NO_PIECE;
+		byPiece.fill(0);
+
+		for (int n = 0; n < ntotal; n++)
+		{
+			board[squares[n]] = pieces[n];
+			byPiece[pieces[n]] |= square_bb(squares[n]);
+		}
+		byColor[WHITE] = byPiece[W_PAWN] | byPiece[W_KNIGHT] | byPiece[W_BISHOP] | byPiece[W_ROOK] | byPiece[W_QUEEN] | byPiece[W_KING];
+		byColor[BLACK] = byPiece[B_PAWN] | byPiece[B_KNIGHT] | byPiece[B_BISHOP] | byPiece[B_ROOK] | byPiece[B_QUEEN] | byPiece[B_KING];
+		occupied = byColor[WHITE] | byColor[BLACK];
+	}
+
+	[[nodiscard]] inline Piece pieceOn(Square sq) const
+	{
+		return board[sq];
+	}
+
+	//Pieces of color c attacking square s. Same as Position::attackers_to(s) & pieces(c)
+	[[nodiscard]] inline Bitboard attackersTo(Square s, Color c) const
+	{
+		const Bitboard queens = byPiece[make_piece(c, QUEEN)];
+		return (PawnAttacks[~c][s] & byPiece[make_piece(c, PAWN)])
+			| (attacks_bb<KNIGHT>(s) & byPiece[make_piece(c, KNIGHT)])
+			| (attacks_bb<BISHOP>(s, occupied) & (byPiece[make_piece(c, BISHOP)] | queens))
+			| (attacks_bb<ROOK>(s, occupied) & (byPiece[make_piece(c, ROOK)] | queens))
+			| (attacks_bb<KING>(s) & byPiece[make_piece(c, KING)]);
+	}
+};
@@ -1,5 +1,6 @@
 #include "LegalChecker.h"
 #include "LegalParams.h"
+#include "PackedPosition.h"
 #include "position.h"
 #include "thread.h"
 #include <omp.h>
@@ -39,28 +40,34 @@ const std::array<int, PIECE_NB>& LegalChecker::getCount() const
 	return count;
 }
 
-void LegalChecker::init(LegalParams* lpIn, int tnum)
+double LegalChecker::getSampleWeight() const
 {
-	maxcount[W_PAWN] = 8;
-	maxcount[W_KNIGHT] = 2;
-	maxcount[W_BISHOP] = 2;
-	maxcount[W_ROOK] = 2;
-	maxcount[W_QUEEN] = 3;
-	maxcount[B_PAWN] = 8;
-	maxcount[B_KNIGHT] = 2;
-	maxcount[B_BISHOP] = 2;
-	maxcount[B_ROOK] = 2;
-	maxcount[B_QUEEN] = 3;
+	return sampleWeight;
+}
 
+ERule LegalChecker::getRejectedBy() const
+{
+	return rejectedBy;
+}
+
+void LegalChecker::init(LegalParams* lpIn, int tnum)
+{
 	lp = lpIn;
 	threadNum = tnum;
 }
 
 
+void LegalChecker::setStratum(int s)
+{
+	stratum = s;
+}
+
+
 //Create random board for mates
 bool LegalChecker::prepareMate()
 {
 	resetArr(count);
+	drawnFrom = nullptr;
 	int n = 2;
 	auto addOne = [&](Piece p, int ncount)
 	{
@@ -98,19 +105,6 @@ bool LegalChecker::prepareMate()
 	addOne(W_ROOK, wr);
 	addOne(B_ROOK, br);
 
-	Bitboard bbAll = 0;
-
-	auto drawLoc = [&]()
-	{
-		int rLoc = -1;
-		do
-		{
-			rLoc = lp->intRand(int(SQ_A1), int(SQ_H8), threadNum);
-		} while ((bbAll & ((uint64_t)1 << rLoc)) != 0);
-		bbAll |= (uint64_t)1 << rLoc;
-		return Square(rLoc);
-	};
-
 	int idx = lp->intRand(threadNum, lp->kingLocDistribution);
 	wk = lp->whiteKingLocs[idx];
 	bk = lp->blackKingLocs[idx];
@@ -121,17 +115,7 @@ bool LegalChecker::prepareMate()
 	pieces[1] = B_KING;
 	setKingInfo();
 
-	bbAll |= (uint64_t)1 << wk;
-	bbAll |= (uint64_t)1 << bk;
-
-	for (int n = 2; n < nTotal; n++)
-	{
-		auto sq = drawLoc();
-		if ((pieces[n] == W_PAWN || pieces[n] == B_PAWN) && (sq < SQ_A2 || sq > SQ_H7))
-			return false;
-		squares[n] = sq;
-	}
-	return true;
+	return placePieces() > 0;
 }
 
 
@@ -139,10 +123,12 @@ bool LegalChecker::prepareMate()
 bool LegalChecker::prepareMateVarious()
 {
 	resetArr(count);
+	drawnFrom = nullptr;
 	int n = 2;
 	nTotal = lp->intRand(8, 32, threadNum);
 
-	for (int c=0; c< nTotal; c++)
+	//nTotal counts the kings too
+	for (int c = 2; c < nTotal; c++)
 	{
 		int ptn = -1;
 		if (lp->intRand(0, 1000, threadNum) == 0)
@@ -161,19 +147,6 @@ bool LegalChecker::prepareMateVarious()
 
 	
 
-	Bitboard bbAll = 0;
-
-	auto drawLoc = [&]()
-	{
-		int rLoc = -1;
-		do
-		{
-			rLoc = lp->intRand(int(SQ_A1), int(SQ_H8), threadNum);
-		} while ((bbAll & ((uint64_t)1 << rLoc)) != 0);
-		bbAll |= (uint64_t)1 << rLoc;
-		return Square(rLoc);
-	};
-
 	int idx = lp->intRand(threadNum, lp->kingLocDistribution);
 	wk = lp->whiteKingLocs[idx];
 	bk = lp->blackKingLocs[idx];
@@ -184,24 +157,17 @@ bool LegalChecker::prepareMateVarious()
 	pieces[1] = B_KING;
 	setKingInfo();
 
-	bbAll |= (uint64_t)1 << wk;
-	bbAll |= (uint64_t)1 << bk;
-
-	for (int n = 2; n < nTotal; n++)
-	{
-		auto sq = drawLoc();
-		if ((pieces[n] == W_PAWN || pieces[n] == B_PAWN) && (sq < SQ_A2 || sq > SQ_H7))
-			return false;
-		squares[n] = sq;
-	}
-	return true;
+	return placePieces() > 0;
 }
 
 //Create random board
 template<ESampleType sampleType>
 bool LegalChecker::prepare()
 {
+	lp->beginSample(threadNum);
 	resetArr(count);
+	sfPositionsSet = false;
+	fromRecord = false;
 
 	int n = 2;
 	auto addOne = [&](Piece p, int ncount)
@@ -214,30 +180,13 @@ bool LegalChecker::prepare()
 		}
 	};
 
-	if (sampleType == ESampleType::RESTRICTED)
-	{
-		auto [wp, bp, wn, bn, wb, bb, wr, br, wq, bq] = lp->drawNumRestricted(kingInPawnSquares);
-		nTotal = wp + bp + wn + bn + wb + bb + wr + br + wq + bq + 2;
-		assert(wp + bp <= 16 && wn + bn <= 4 && wb + bb <= 4 && wr + br <= 4 && wq + bq <= 6);
-		assert(nTotal <= 32);
-
-		addOne(W_PAWN, wp);
-		addOne(B_PAWN, bp);
-		addOne(W_QUEEN, wq);
-		addOne(B_QUEEN, bq);
-		addOne(W_KNIGHT, wn);
-		addOne(B_KNIGHT, bn);
-		addOne(W_BISHOP, wb);
-		addOne(B_BISHOP, bb);
-		addOne(W_ROOK, wr);
-		addOne(B_ROOK, br);
-	}
-	else if (sampleType == ESampleType::VERY_RESTRICTED)
+	drawnFrom = nullptr;
+	if (sampleType == ESampleType::RESTRICTED || sampleType == ESampleType::VERY_RESTRICTED)
 	{
-		auto [wp, bp, wn, bn, wb, bb, wr, br, wq, bq] = lp->drawNumVeryRestricted(kingInPawnSquares);
+		auto [wp, bp, wn, bn, wb, bb, wr, br, wq, bq] = lp->drawNumRestricted(kingInPawnSquares, stratum);
 		nTotal = wp + bp + wn + bn + wb + bb + wr + br + wq + bq + 2;
-		assert(wp + bp <= 16 && wn + bn <= 4 && wb + bb <= 4 && wr + br <= 4 && wq + bq <= 2);
 		assert(nTotal <= 32);
+		drawnFrom = &lp->profile;
 
 		addOne(W_PAWN, wp);
 		addOne(B_PAWN, bp);
@@ -260,7 +209,7 @@ bool LegalChecker::prepare()
 			auto p = lp->pickWPiece(threadNum);
 			count[p]++;
 			//No need to continue if we know that it won't be restricted
-			if (sampleType == ESampleType::WB_RESTRICTED && count[p] > maxcount[p])
+			if (sampleType == ESampleType::WB_RESTRICTED && count[p] > lp->profile.maxcount[p])
 				return false;
 			pieces[n++] = p;
 		}
@@ -270,7 +219,7 @@ bool LegalChecker::prepare()
 			auto p = lp->pickBPiece(threadNum);;
 			count[p]++;
 			//No need to continue if we know that it won't be restricted
-			if (sampleType == ESampleType::WB_RESTRICTED && count[p] > maxcount[p])
+			if (sampleType == ESampleType::WB_RESTRICTED && count[p] > lp->profile.maxcount[p])
 				return false;
 			pieces[n++] = p;
 		}
@@ -287,19 +236,6 @@ bool LegalChecker::prepare()
 		}
 	}
 
-	Bitboard bbAll = 0;
-	
-	auto drawLoc = [&]()
-	{
-		int rLoc = -1;
-		do
-		{
-			rLoc = lp->intRand(int(SQ_A1), int(SQ_H8), threadNum);
-		} while ((bbAll & ((uint64_t)1 << rLoc)) != 0);
-		bbAll |= (uint64_t)1 << rLoc;
-		return Square(rLoc);
-	};
-
 	//Kings are put into random locations where they are not on neighboring squares
 	int idx = lp->intRand(threadNum, lp->kingLocDistribution);
 	wk = lp->whiteKingLocs[idx];
@@ -311,18 +247,51 @@ bool LegalChecker::prepare()
 	pieces[1] = B_KING;
 	setKingInfo();
 
-	bbAll |= (uint64_t)1 << wk;
-	bbAll |= (uint64_t)1 << bk;
+	//Pawns only go to RANK_2-RANK_7, so the sample counts as the fraction of the placements where pawns would land there
+	sampleWeight = placePieces();
+	return sampleWeight > 0;
+}
+
 
+//Put pieces[2..nTotal) on random empty squares without retries. Pawns are placed first and only on RANK_2-RANK_7.
+//Returns the probability that placing all the pieces uniformly on the 62 empty squares would have put every pawn on
+//RANK_2-RANK_7 (0 if there aren't enough pawn squares)
+double LegalChecker::placePieces()
+{
+	//Partial Fisher-Yates: free RANK_1/RANK_8 squares are in [0, nBack), free pawn squares in [nBack, nFree).
+	//A picked square is replaced with the last free one
+	std::array<Square, SQUARE_NB> freeSq;
+	const Bitboard kings = square_bb(wk) | square_bb(bk);
+	int nFree = 0;
+	for (Bitboard b = (Rank1BB | Rank8BB) & ~kings; b; )
+		freeSq[nFree++] = pop_lsb(&b);
+	const int nBack = nFree;
+	for (Bitboard b = ~(Rank1BB | Rank8BB | kings); b; )
+		freeSq[nFree++] = pop_lsb(&b);
+
+	double weight = 1.0;
 	for (int n = 2; n < nTotal; n++)
 	{
-		auto sq = drawLoc();
-		//Performance optimization - quit early if pawns on wrong squares
-		if ((pieces[n] == W_PAWN || pieces[n] == B_PAWN) && (sq < SQ_A2 || sq > SQ_H7))	
-			return false;
-		squares[n] = sq;
+		if (pieces[n] != W_PAWN && pieces[n] != B_PAWN)
+			continue;
+		const int npool = nFree - nBack;
+		if (npool == 0)
+			return 0;
+		weight *= double(npool) / nFree;
+		const int i = nBack + lp->intRand(0, npool - 1, threadNum);
+		squares[n] = freeSq[i];
+		freeSq[i] = freeSq[--nFree];
 	}
-	return true;
+
+	for (int n = 2; n < nTotal; n++)
+	{
+		if (pieces[n] == W_PAWN || pieces[n] == B_PAWN)
+			continue;
+		const int i = lp->intRand(0, nFree - 1, threadNum);
+		squares[n] = freeSq[i];
+		freeSq[i] = freeSq[--nFree];
+	}
+	return weight;
 }
 
 
@@ -382,26 +351,22 @@ bool LegalChecker::checkPawnRanks() const
 	return true;
 }
 
-bool LegalChecker::checkAdditionalConditions(bool underpromotions, int maxQueensOneSide, int maxQueensTotal) const
+//Is the position within the restriction profile? Counts drawn from the profile's own combinations are within its caps
+//already, so then only the bishops are left to check
+bool LegalChecker::checkAdditionalConditions(const RestrictionProfile& rp) const
 {
-	if (maxQueensOneSide != -1)
+	if (&rp != drawnFrom)
 	{
-		if (count[W_QUEEN] > maxQueensOneSide || count[B_QUEEN] > maxQueensOneSide)
-			return false;
-	}
+		for (Piece p : { W_PAWN, W_KNIGHT, W_BISHOP, W_ROOK, W_QUEEN, B_PAWN, B_KNIGHT, B_BISHOP, B_ROOK, B_QUEEN })
+			if (count[p] > rp.maxcount[p])
+				return false;
 
-	if (maxQueensTotal != -1)
-	{
-		if (count[W_QUEEN] + count[B_QUEEN] > maxQueensTotal)
+		if (rp.caps.maxQueensTotal >= 0 && count[W_QUEEN] + count[B_QUEEN] > rp.caps.maxQueensTotal)
 			return false;
 	}
 
-	if (!underpromotions)
+	if (!rp.underpromotions)
 	{
-		if (count[W_BISHOP] > 2 || count[W_KNIGHT] > 2 || count[W_ROOK] > 2
-			|| count[B_BISHOP] > 2 || count[B_KNIGHT] > 2 || count[B_ROOK] > 2)
-			return false;
-
 		auto checkBishops = [&](Piece p)
 		{
 			int found = 0;
@@ -523,27 +488,51 @@ bool LegalChecker::checkCounts() const
 }
 
 
-void LegalChecker::setSFPositions()
+void LegalChecker::setSFPositions() const
 {
 	std::memset(&posWTM, 0, sizeof(Position));
 	std::memset(&lp->states[threadNum]->back(), 0, sizeof(StateInfo));
 
-	posWTM.setMine(nTotal, pieces, squares, SQ_NONE, &lp->states[threadNum]->back(), Threads.main(), WHITE);
+	if (fromRecord)
+		posWTM.set(record.fen(), false, &lp->states[threadNum]->back(), Threads.main());
+	else
+		posWTM.setMine(nTotal, pieces, squares, SQ_NONE, &lp->states[threadNum]->back(), Threads.main(), WHITE);
 
 	std::memset(&posBTM, 0, sizeof(Position));
 	std::memset(&lp->states2[threadNum]->back(), 0, sizeof(StateInfo));
 
 	posBTM.setMine(nTotal, pieces, squares, SQ_NONE, &lp->states2[threadNum]->back(), Threads.main(), BLACK);
+	sfPositionsSet = true;
+}
+
+
+void LegalChecker::needSFPositions() const
+{
+	if (!sfPositionsSet)
+		setSFPositions();
+}
+
+
+//Black pieces checking the white king
+Bitboard LegalChecker::whiteKingCheckers() const
+{
+	return lp->leanBoard ? board.attackersTo(wk, BLACK) : posWTM.checkers();
+}
+
+
+bool LegalChecker::isBlackInCheck() const
+{
+	return lp->leanBoard ? board.attackersTo(bk, WHITE) != 0 : posBTM.checkers() != 0;
 }
 
 
 Piece LegalChecker::pieceOn(Square sq) const
 {
-	return posWTM.piece_on(sq);
+	return board.pieceOn(sq);
 }
 
 
-bool LegalChecker::checkPieces(const std::vector<std::pair<Square, Piece>>& psq) const
+bool LegalChecker::checkPieces(std::initializer_list<std::pair<Square, Piece>> psq) const
 {
 	for (auto p : psq)
 		if (pieceOn(p.first) != p.second)
@@ -614,51 +603,50 @@ bool LegalChecker::checkBishops() const
 }
 
 
-bool LegalChecker::pawnStructureOk(const std::vector<Square>& plist, Piece p) const
+constexpr Bitboard pawnsBB(std::initializer_list<Square> squares)
 {
-	//4 total flips
-	bool all = true;
-	for (Square s : plist)
-		if (pieceOn(s) != p)
-			all = false;
-	if (all)
-		return false;
+	Bitboard b = 0;
+	for (Square sq : squares)
+		b |= Bitboard(1) << sq;
+	return b;
+}
 
-	all = true;
-	for (Square s : plist)
-		if (pieceOn(flip_file(s)) != p)
-			all = false;
-	if (all)
-		return false;
 
-	all = true;
-	for (Square s : plist)
-		if (pieceOn(flip_rank(s)) != ~p)
-			all = false;
-	if (all)
-		return false;
+constexpr Bitboard pawnsBB(int f, Rank r)
+{
+	return Bitboard(1) << make_square(File(f), r);
+}
 
-	all = true;
-	for (Square s : plist)
-		if (pieceOn(flip_file(flip_rank(s))) != ~p)
-			all = false;
-	if (all)
-		return false;
-	return true;
-};
+
+constexpr Bitboard flipFiles(Bitboard b)
+{
+	Bitboard flipped = 0;
+	for (int sq = 0; sq < SQUARE_NB; sq++)
+		if (b & (Bitboard(1) << sq))
+			flipped |= Bitboard(1) << flip_file(Square(sq));
+	return flipped;
+}
 
 
-bool LegalChecker::checkPawnStructures() const
+constexpr Bitboard flipRanks(Bitboard b)
 {
+	Bitboard flipped = 0;
+	for (int sq = 0; sq < SQUARE_NB; sq++)
+		if (b & (Bitboard(1) << sq))
+			flipped |= Bitboard(1) << flip_rank(Square(sq));
+	return flipped;
+}
+
 
-	//Impossible pawn structures on the sides
+//Impossible pawn structures on the sides (white pawns, A file). They are also impossible on the H file
+constexpr std::array<Bitboard, 11> sidePawnStructures =
+{
 	//...
 	//P..
 	//PP.
 	//...
 	//7k/8/8/8/8/7P/6PP/4K3 w - - 0 
-	if (!pawnStructureOk({ SQ_A2, SQ_B2, SQ_A3 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A2, SQ_B2, SQ_A3 }),
 
 	//...
 	//P..
@@ -666,8 +654,7 @@ bool LegalChecker::checkPawnStructures() const
 	//PPP
 	//...
 	//5k2/8/8/8/P7/8/PPP3K1/8 w - - 0 2
-	if (!pawnStructureOk({ SQ_A2, SQ_B2, SQ_C2, SQ_A4 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A2, SQ_B2, SQ_C2, SQ_A4 }),
 
 	//...
 	//P..
@@ -675,8 +662,7 @@ bool LegalChecker::checkPawnStructures() const
 	//P.P
 	//...
 	//6k1/8/8/8/P7/1P6/P1P5/6K1 w - - 0 2
-	if (!pawnStructureOk({ SQ_A2, SQ_B3, SQ_C2, SQ_A4 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A2, SQ_B3, SQ_C2, SQ_A4 }),
 
 	//...
 	//P..
@@ -684,8 +670,7 @@ bool LegalChecker::checkPawnStructures() const
 	//P.P
 	//...
 	//6k1/8/8/8/P7/P7/P1P5/6K1 w - - 0 2
-	if (!pawnStructureOk({ SQ_A2, SQ_A3, SQ_C2, SQ_A4 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A2, SQ_A3, SQ_C2, SQ_A4 }),
 
 	//...
 	//...
@@ -693,8 +678,7 @@ bool LegalChecker::checkPawnStructures() const
 	//P.P
 	//...
 	//6k1/8/8/8/8/PP6/P1P5/6K1 w - - 0 4
-	if (!pawnStructureOk({ SQ_A2, SQ_A3, SQ_B3, SQ_C2 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A2, SQ_A3, SQ_B3, SQ_C2 }),
 
 	//...
 	//...
@@ -702,8 +686,7 @@ bool LegalChecker::checkPawnStructures() const
 	//.PP
 	//...
 	//6k1/8/8/8/8/PP6/1PP5/6K1 w - - 0 8
-	if (!pawnStructureOk({ SQ_A3, SQ_B2, SQ_B3, SQ_C2 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A3, SQ_B2, SQ_B3, SQ_C2 }),
 
 	//...
 	//P..
@@ -711,8 +694,7 @@ bool LegalChecker::checkPawnStructures() const
 	//.PP
 	//...
 	//6k1/8/8/8/P7/1P6/1PP5/6K1 w - - 0 16
-	if (!pawnStructureOk({ SQ_A4, SQ_B2, SQ_B3, SQ_C2 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A4, SQ_B2, SQ_B3, SQ_C2 }),
 
 	//...
 	//P..
@@ -720,8 +702,7 @@ bool LegalChecker::checkPawnStructures() const
 	//..P
 	//...
 	//6k1/8/8/8/P7/PP6/2P5/6K1 w - - 0 8
-	if (!pawnStructureOk({ SQ_A4, SQ_A3, SQ_B3, SQ_C2 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A4, SQ_A3, SQ_B3, SQ_C2 }),
 
 	//...
 	//P..
@@ -729,8 +710,7 @@ bool LegalChecker::checkPawnStructures() const
 	//.PP
 	//...
 	//4k3/8/8/8/P7/P7/1PP5/4K3 w - - 0 2
-	if (!pawnStructureOk({ SQ_A4, SQ_A3, SQ_B2, SQ_C2 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A4, SQ_A3, SQ_B2, SQ_C2 }),
 
 	//...
 	//P..
@@ -738,8 +718,7 @@ bool LegalChecker::checkPawnStructures() const
 	//P..
 	//...
 	//4k3/8/8/8/P7/PP6/P7/4K3 w - - 0 2
-	if (!pawnStructureOk({ SQ_A4, SQ_A3, SQ_A2, SQ_B3 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A4, SQ_A3, SQ_A2, SQ_B3 }),
 
 	//...
 	//P..
@@ -747,71 +726,69 @@ bool LegalChecker::checkPawnStructures() const
 	//PP.
 	//...
 	//4k3/8/8/8/P7/1P6/PP6/4K3 w - - 0 2
-	if (!pawnStructureOk({ SQ_A4, SQ_A2, SQ_B2, SQ_B3 }, W_PAWN))
-		return false;
+	pawnsBB({ SQ_A4, SQ_A2, SQ_B2, SQ_B3 })
+};
 
-	for (File c = FILE_B; c <= FILE_G; ++c)
+constexpr int FORBIDDEN_PAWN_STRUCTURES = 2 * int(sidePawnStructures.size()) + 6 + 2 * 5;
+
+
+//All impossible pawn structures as masks: a side loses if (its pawns & mask) == mask.
+//Black's masks are white's with the ranks flipped
+constexpr auto makeForbiddenPawnStructures()
+{
+	std::array<std::array<Bitboard, FORBIDDEN_PAWN_STRUCTURES>, COLOR_NB> masks{};
+	int n = 0;
+	auto add = [&](Bitboard white)
 	{
-		//Detect these impossible pawn structures:
-		//  P      
-		// PPP   
-		// ...
-		//7k/8/8/8/8/2P5/1PPP4/4K3 w - - 0 
-		if (pieceFR(c, RANK_2) == W_PAWN
-			&& pieceFR(File(c - 1), RANK_2) == W_PAWN
-			&& pieceFR(File(c + 1), RANK_2) == W_PAWN
-			&& pieceFR(c, RANK_3) == W_PAWN)
-			return false;
+		masks[WHITE][n] = white;
+		masks[BLACK][n++] = flipRanks(white);
+	};
 
-		if (pieceFR(c, RANK_7) == B_PAWN
-			&& pieceFR(File(c - 1), RANK_7) == B_PAWN
-			&& pieceFR(File(c + 1), RANK_7) == B_PAWN
-			&& pieceFR(c, RANK_6) == B_PAWN)
-			return false;
+	for (Bitboard b : sidePawnStructures)
+	{
+		add(b);
+		add(flipFiles(b));
 	}
 
-	for (File c = FILE_B; c <= FILE_F; ++c)
+	//  P      
+	// PPP   
+	// ...
+	//7k/8/8/8/8/2P5/1PPP4/4K3 w - - 0 
+	for (int c = FILE_B; c <= FILE_G; c++)
+		add(pawnsBB(c, RANK_2) | pawnsBB(c - 1, RANK_2) | pawnsBB(c + 1, RANK_2) | pawnsBB(c, RANK_3));
+
+	for (int c = FILE_B; c <= FILE_F; c++)
 	{
-		//Detect these impossible pawn structures:
 		//  PP      
 		// P.PP
 		// ...
 		//4k3/8/8/8/8/4PP2/3P1PP1/4K3 w - - 0 2
-		if (pieceFR(c, RANK_3) == W_PAWN
-			&& pieceFR(File(c - 1), RANK_2) == W_PAWN
-			&& pieceFR(File(c + 1), RANK_2) == W_PAWN
-			&& pieceFR(File(c + 1), RANK_3) == W_PAWN
-			&& pieceFR(File(c + 2), RANK_2) == W_PAWN)
-			return false;
-
-		if (pieceFR(c, RANK_6) == B_PAWN
-			&& pieceFR(File(c - 1), RANK_7) == B_PAWN
-			&& pieceFR(File(c + 1), RANK_7) == B_PAWN
-			&& pieceFR(File(c + 1), RANK_6) == B_PAWN
-			&& pieceFR(File(c + 2), RANK_7) == B_PAWN)
-			return false;
+		add(pawnsBB(c, RANK_3) | pawnsBB(c - 1, RANK_2) | pawnsBB(c + 1, RANK_2) | pawnsBB(c + 1, RANK_3) | pawnsBB(c + 2, RANK_2));
 
-		//Detect these impossible pawn structures:
 		//  PP      
 		// PP.P
 		// ...
 		//4k3/8/8/8/8/4PP2/3P1PP1/4K3 w - - 0 2
-		if (pieceFR(c, RANK_3) == W_PAWN
-			&& pieceFR(File(c - 1), RANK_2) == W_PAWN
-			&& pieceFR(c, RANK_2) == W_PAWN
-			&& pieceFR(File(c + 1), RANK_3) == W_PAWN
-			&& pieceFR(File(c + 2), RANK_2) == W_PAWN)
-			return false;
-
-		if (pieceFR(c, RANK_6) == B_PAWN
-			&& pieceFR(File(c - 1), RANK_7) == B_PAWN
-			&& pieceFR(c, RANK_7) == B_PAWN
-			&& pieceFR(File(c + 1), RANK_6) == B_PAWN
-			&& pieceFR(File(c + 2), RANK_7) == B_PAWN)
-			return false;
+		add(pawnsBB(c, RANK_3) | pawnsBB(c - 1, RANK_2) | pawnsBB(c, RANK_2) | pawnsBB(c + 1, RANK_3) | pawnsBB(c + 2, RANK_2));
 	}
+	assert(n == FORBIDDEN_PAWN_STRUCTURES);
+	return masks;
+}
 
-	return true;
+constexpr auto forbiddenPawnStructures = makeForbiddenPawnStructures();
+
+
+bool LegalChecker::checkPawnStructures() const
+{
+	//No early exits: the loop over the masks is short and vectorizes
+	bool bad = false;
+	for (Color c : { WHITE, BLACK })
+	{
+		const Bitboard pawns = board.byPiece[make_piece(c, PAWN)];
+		for (Bitboard mask : forbiddenPawnStructures[c])
+			bad |= (pawns & mask) == mask;
+	}
+	return !bad;
 }
 
 
@@ -946,7 +923,7 @@ int bitCount(uint64_t n)
 
 int LegalChecker::countAttacks() const
 {
-	return bitCount(posWTM.checkers());		//Get the number of pieces checking the white king from the bitboard
+	return bitCount(whiteKingCheckers());		//Get the number of pieces checking the white king from the bitboard
 }
 
 
@@ -979,18 +956,19 @@ void LegalChecker::listBlackEnPassants()
 
 Bitboard LegalChecker::betweenKingAndAttacker(Square attacker, PieceType pt) const
 {
-	return attacks_bb(pt, attacker, posBTM.pieces())
-		& attacks_bb(pt, wk, posBTM.pieces()) & (~posBTM.pieces());
+	return attacks_bb(pt, attacker, board.occupied)
+		& attacks_bb(pt, wk, board.occupied) & (~board.occupied);
 }
 
 //Those that check white king
 void LegalChecker::makeListOfAttackers()
 {
-	auto myat = posWTM.checkers();
-	attackers.resize(nattacks);
-	for (Attacker& a : attackers)
+	auto myat = whiteKingCheckers();
+	for (int q = 0; q < nattacks; q++)
 	{
+		Attacker& a = attackers[q];
 		assert(myat);
+		a = Attacker();		//Not all fields are set below, none may be left from an earlier sample
 		a.pos = pop_lsb(&myat);
 		a.abit = uint64_t(1) << a.pos;
 		a.piece = pieceOn(a.pos);
@@ -1006,19 +984,19 @@ void LegalChecker::makeListOfAttackers()
 			if (a.pt == PAWN)
 			{
 				if (nWhite < 16)	//Must have captured a white piece
-					a.comeFrom = (shift<NORTH_WEST>(a.abit) | shift<NORTH_EAST>(a.abit)) & ~posBTM.pieces();
+					a.comeFrom = (shift<NORTH_WEST>(a.abit) | shift<NORTH_EAST>(a.abit)) & ~board.occupied;
 					//No need to worry about moves such as b7-b5 or b7-b6 because a non-capture pawn move can't result in discovery check without promotions
 			}
 			else
-				a.comeFrom = a.piece == B_QUEEN ? 0 : attacks_bb(a.pt, a.pos, posBTM.pieces()) & ~posBTM.pieces();	//Queen can't be a blocker
+				a.comeFrom = a.piece == B_QUEEN ? 0 : attacks_bb(a.pt, a.pos, board.occupied) & ~board.occupied;	//Queen can't be a blocker
 
 			if (a.rank == RANK_1 && count[B_PAWN] < 8)	//Promotion by black means less than 8 black pawns
 			{
 				//Promotion possible
 				//White king's location couldn't have been attacked by that black pawn before promotion or it'd be an illegal position
-				a.comeFrom |= shift<NORTH>(a.abit) & ~posBTM.pieces() & ~PawnAttacks[WHITE][wk];
+				a.comeFrom |= shift<NORTH>(a.abit) & ~board.occupied & ~PawnAttacks[WHITE][wk];
 				if (nWhite < 16)	//Must have been a capture for the pawn to move diagonally and it couldn't be a pawn on rank 1
-					a.comeFrom |= (shift<NORTH_WEST>(a.abit) | shift<NORTH_EAST>(a.abit)) & ~posBTM.pieces() & ~PawnAttacks[WHITE][wk];
+					a.comeFrom |= (shift<NORTH_WEST>(a.abit) | shift<NORTH_EAST>(a.abit)) & ~board.occupied & ~PawnAttacks[WHITE][wk];
 			}
 		}
 
@@ -1036,8 +1014,9 @@ bool LegalChecker::isDoubleDiscEPPossible() const
 	Square asBishopLoc = SQ_NONE;	//Diagonal check
 	Square asRookLoc = SQ_NONE;	//Horizontal or vertical check
 
-	for (auto& a : attackers)
+	for (int q = 0; q < nattacks; q++)
 	{
+		const Attacker& a = attackers[q];
 		if (a.pt == BISHOP)
 			asBishopLoc = a.pos;
 		if (a.pt == ROOK)
@@ -1154,12 +1133,12 @@ bool LegalChecker::checkSingleAttacked() const
 
 	if (att.directAttack && (att.piece == B_QUEEN || att.piece == B_BISHOP || att.piece == B_ROOK || att.piece == B_KNIGHT) && !didBlackPossCastled)
 	{
-		Bitboard bb = attacks_bb(type_of(att.piece), att.pos, posWTM.pieces()) & ~posWTM.pieces();
+		Bitboard bb = attacks_bb(type_of(att.piece), att.pos, board.occupied) & ~board.occupied;
 		bool anyOk = false;
 		while (bb)
 		{
 			Square sqFrom = pop_lsb(&bb);
-			if ((attacks_bb(type_of(att.piece), sqFrom, posWTM.pieces() & ~att.abit) & wkBit) == 0)
+			if ((attacks_bb(type_of(att.piece), sqFrom, board.occupied & ~att.abit) & wkBit) == 0)
 			{
 				anyOk = true;
 				break;
@@ -1169,7 +1148,7 @@ bool LegalChecker::checkSingleAttacked() const
 		{
 			//Possibly promoted pawn has no place to come from
 			//2NNr2N/2k3B1/1bP1qpn1/N1q1RPp1/1n1p1R2/1NQ2N1q/1p1nKpr1/5bR1 w - - 0 1
-			Bitboard bb2 = (shift<NORTH>(att.abit) | shift<NORTH_WEST>(att.abit) | shift<NORTH_EAST>(att.abit)) & ~posBTM.pieces();
+			Bitboard bb2 = (shift<NORTH>(att.abit) | shift<NORTH_WEST>(att.abit) | shift<NORTH_EAST>(att.abit)) & ~board.occupied;
 			while (bb2)
 			{
 				Square sqFrom = pop_lsb(&bb2);
@@ -1189,7 +1168,7 @@ bool LegalChecker::checkSingleAttacked() const
 	{
 		if (att.rank == RANK_7)	//A pawn that hasn't moved from the starting location can't be checking
 			return false;
-		Bitboard bb = (shift<NORTH>(att.abit) | shift<NORTH_WEST>(att.abit) | shift<NORTH_EAST>(att.abit)) & ~posBTM.pieces();
+		Bitboard bb = (shift<NORTH>(att.abit) | shift<NORTH_WEST>(att.abit) | shift<NORTH_EAST>(att.abit)) & ~board.occupied;
 
 		if (bb == 0)
 			return false;
@@ -1230,13 +1209,15 @@ int LegalChecker::totalPieces() const
 
 void LegalChecker::fromFen(const std::string& fen)
 {
+	drawnFrom = nullptr;
+	fromRecord = false;
 	std::memset(&posWTM, 0, sizeof(Position));
 	std::memset(&lp->states[threadNum]->back(), 0, sizeof(StateInfo));
 	posWTM.set(fen, false, &lp->states[threadNum]->back(), Threads.main());
 
 	for (Square sq = SQ_A1; sq <= SQ_H8; ++sq)
 	{
-		Piece p = pieceOn(sq);
+		Piece p = posWTM.piece_on(sq);
 		if (p == W_KING)
 		{
 			wk = sq;
@@ -1256,7 +1237,7 @@ void LegalChecker::fromFen(const std::string& fen)
 
 	for (Square sq = SQ_A1; sq <= SQ_H8; ++sq)
 	{
-		Piece p = pieceOn(sq);
+		Piece p = posWTM.piece_on(sq);
 		if (p != NO_PIECE && p != W_KING && p != B_KING)
 		{
 			squares[loc] = sq;
@@ -1265,15 +1246,102 @@ void LegalChecker::fromFen(const std::string& fen)
 	}
 
 	nTotal = loc;
+	board.set(nTotal, pieces, squares);
+	sfPositionsSet = false;
+	setKingInfo();
+}
+
+
+//As fromFen, straight from the packed codes without going through a Stockfish position. The checks are for white to
+//move, so a black-to-move record is mirrored with the colors swapped, as revalidate does. The Stockfish positions keep
+//the castling rights and en passant of the (mirrored) record
+void LegalChecker::fromPacked(const PackedPosition& pp)
+{
+	CodeBoard codes;
+	pp.toCodes(codes);
+	bool blackToMove = false;
+	for (Bitboard b = pp.occupied; b; )
+		blackToMove |= codes[pop_lsb(&b)] == PackedPosition::BLACK_KING_TO_MOVE;
+
+	Bitboard occupied = pp.occupied;
+	if (blackToMove)
+	{
+		//A castling rook or en passant pawn takes its color from its rank, so flipping the rank is enough for them
+		CodeBoard mirrored;
+		occupied = 0;
+		for (Bitboard b = pp.occupied; b; )
+		{
+			const Square sq = pop_lsb(&b);
+			const uint8_t code = codes[sq];
+			mirrored[flip_rank(sq)] = code == PackedPosition::CASTLING_ROOK || code == PackedPosition::EP_PAWN ? code
+				: code == PackedPosition::BLACK_KING_TO_MOVE ? uint8_t(W_KING) : uint8_t(~Piece(code));
+			occupied |= square_bb(flip_rank(sq));
+		}
+		codes = mirrored;
+	}
+
+	std::array<Piece, SQUARE_NB> placed;
+	for (Bitboard b = occupied; b; )
+	{
+		const Square sq = pop_lsb(&b);
+		placed[sq] = PackedPosition::piece(codes[sq], sq);
+	}
+	fromBoard(placed, occupied);
+	record = blackToMove ? PackedPosition::fromCodes(occupied, codes) : pp;
+	fromRecord = true;
+}
+
+
+//The pieces on the occupied squares, one king of each color and at most 32 pieces, white to move
+void LegalChecker::fromBoard(const std::array<Piece, SQUARE_NB>& placed, Bitboard occupied)
+{
+	drawnFrom = nullptr;
+	fromRecord = false;
+	int loc = 2;
+	for (Bitboard b = occupied; b; )
+	{
+		const Square sq = pop_lsb(&b);
+		const Piece p = placed[sq];
+		if (p == W_KING)
+		{
+			wk = sq;
+			squares[0] = wk;
+			pieces[0] = W_KING;
+		}
+		else if (p == B_KING)
+		{
+			bk = sq;
+			squares[1] = bk;
+			pieces[1] = B_KING;
+		}
+		else
+		{
+			squares[loc] = sq;
+			pieces[loc++] = p;
+		}
+	}
+
+	assert(wk != SQUARE_NB && bk != SQUARE_NB);
+	nTotal = loc;
+	board.set(nTotal, pieces, squares);
+	sfPositionsSet = false;
 	setKingInfo();
 }
 
 
 std::string LegalChecker::fen() const
 {
+	needSFPositions();
 	return posWTM.fen();
 }
 
+//White to move, as fen(). After fromPacked, the record mirrored if black was to move
+const Position& LegalChecker::position() const
+{
+	needSFPositions();
+	return posWTM;
+}
+
 bool LegalChecker::isSanityCheck() const
 {
 	return checkBySide() && checkPawnRanks();
@@ -1302,6 +1370,7 @@ bool LegalChecker::checkOpening(const OpeningLimit& ol) const
 
 std::pair<bool, bool> LegalChecker::isMatedOrStalemated() const
 {
+	needSFPositions();
 	auto legalMoves = MoveList<LEGAL>(posWTM);
 	if (legalMoves.size() == 0)
 		if (posWTM.checkers())
@@ -1352,12 +1421,12 @@ bool LegalChecker::isMated(int inMoves)
 	}
 	for (const Move move : MoveList<LEGAL>(posWTM))
 	{
-		if (!posWTM.gives_check(move) && posWTM.capture_or_promotion(move) && pieceOn(to_sq(move)) == W_QUEEN)
+		if (!posWTM.gives_check(move) && posWTM.capture_or_promotion(move) && posWTM.piece_on(to_sq(move)) == W_QUEEN)
 			ordered[n++] = move;
 	}
 	for (const Move move : MoveList<LEGAL>(posWTM))
 	{
-		if (!posWTM.gives_check(move) && posWTM.capture_or_promotion(move) && !(pieceOn(to_sq(move)) == W_QUEEN))
+		if (!posWTM.gives_check(move) && posWTM.capture_or_promotion(move) && !(posWTM.piece_on(to_sq(move)) == W_QUEEN))
 			ordered[n++] = move;
 	}
 	for (const Move move : MoveList<LEGAL>(posWTM))
@@ -1379,6 +1448,7 @@ bool LegalChecker::isMated(int inMoves)
 
 bool LegalChecker::isMate(int inMoves, bool noShorter)
 {
+	needSFPositions();
 	auto oneMove = [&](Move move, int mm)
 	{
 		StateInfo st;
@@ -1432,12 +1502,12 @@ bool LegalChecker::isMate(int inMoves, bool noShorter)
 		}
 		for (const Move move : MoveList<LEGAL>(posWTM))
 		{
-			if (!posWTM.gives_check(move) && posWTM.capture_or_promotion(move) && pieceOn(to_sq(move)) == B_QUEEN)
+			if (!posWTM.gives_check(move) && posWTM.capture_or_promotion(move) && posWTM.piece_on(to_sq(move)) == B_QUEEN)
 				ordered[n++] = move;
 		}
 		for (const Move move : MoveList<LEGAL>(posWTM))
 		{
-			if (!posWTM.gives_check(move) && posWTM.capture_or_promotion(move) && !(pieceOn(to_sq(move)) == B_QUEEN))
+			if (!posWTM.gives_check(move) && posWTM.capture_or_promotion(move) && !(posWTM.piece_on(to_sq(move)) == B_QUEEN))
 				ordered[n++] = move;
 		}
 		for (const Move move : MoveList<LEGAL>(posWTM))
@@ -1470,35 +1540,79 @@ bool LegalChecker::isMate(int inMoves, bool noShorter)
 //maxQueensTotal. -1 == no max
 bool LegalChecker::checkConditions()
 {
-	bool isok = checkBySide();
-	if (!isok)
-		return false;
+	RuleStats& rs = lp->ruleStats[threadNum];
+	const int64_t sampleNum = rs.samples.get();
+	rs.samples.set(sampleNum + 1);
+	const bool timed = sampleNum % RuleStats::TIME_EVERY == 0;
+	boardSet = false;
+
+	bool isok = true;
+	rejectedBy = RULE_NB;
+	for (const auto& ruleInOrder : rs.order)
+	{
+		const ERule rule = ruleInOrder.get();
+		if (RULE_NEEDS_BOARD[rule] && !boardSet)
+		{
+			const uint64_t t0 = timed ? cycleCount() : 0;
+			setBoard();
+			if (timed)
+			{
+				rs.boardCycles.add(cycleCount() - t0);
+				rs.boardTimed.add(1);
+			}
+		}
 
-	isok = checkPawnRanks();
-	if (!isok)
-		return false;
+		const uint64_t t0 = timed ? cycleCount() : 0;
+		isok = checkRule(rule);
+		if (timed)
+		{
+			rs.cycles[rule].add(cycleCount() - t0);
+			rs.timed[rule].add(1);
+		}
+		rs.checked[rule].add(1);
+		if (!isok)
+		{
+			rs.rejected[rule].add(1);
+			rejectedBy = rule;
+			break;
+		}
+	}
 
-	isok = checkCounts();
-	if (!isok)
-		return false;
+	if (lp->adaptiveRuleOrder && (sampleNum + 1) % lp->ruleWarmup == 0)
+		rs.reorder();
+	return isok;
+}
 
-	setSFPositions();
 
-	if (posBTM.checkers())	//Black king in check = illegal position
-		return false;
-	
-	isok = checkBishops();
-	if (!isok)
-		return false;
+bool LegalChecker::checkRule(ERule rule)
+{
+	switch (rule)
+	{
+	case RULE_BY_SIDE: return checkBySide();
+	case RULE_PAWN_RANKS: return checkPawnRanks();
+	case RULE_COUNTS: return checkCounts();
+	case RULE_BLACK_IN_CHECK: return !isBlackInCheck();	//Black king in check = illegal position
+	case RULE_BISHOPS: return checkBishops();
+	case RULE_PAWN_STRUCTURES: return checkPawnStructures();
+	case RULE_SAME_FILE: return checkSameFileAndCounts();
+	case RULE_ATTACKS: return checkAttacks();
+	default: assert(false); return false;
+	}
+}
 
-	isok = checkPawnStructures();
-	if (!isok)
-		return false;
 
-	isok = checkSameFileAndCounts();
-	if (!isok)
-		return false;
-		
+void LegalChecker::setBoard()
+{
+	board.set(nTotal, pieces, squares);
+	sfPositionsSet = false;
+	if (!lp->leanBoard)
+		setSFPositions();
+	boardSet = true;
+}
+
+
+bool LegalChecker::checkAttacks()
+{
 	nattacks = countAttacks();
 
 	if (nattacks >= 3)  //More than 3 pieces checking at once are illegal (at most 2 can result from a discovered check)
@@ -1508,16 +1622,9 @@ bool LegalChecker::checkConditions()
 	makeListOfAttackers();
 
 	if (nattacks == 2)
-	{
-		isok = checkDoubleAttacked();
-	}
+		return checkDoubleAttacked();
 	else if (nattacks == 1)
-	{
-		isok = checkSingleAttacked();
-	}
-	if (!isok)
-		return false;
-
+		return checkSingleAttacked();
 	return true;
 }
 
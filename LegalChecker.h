@@ -2,16 +2,23 @@
 
 #include "position.h"
 #include "OpeningLimit.h"
+#include "LeanBoard.h"
+#include "PackedPosition.h"
+#include "RuleStats.h"
+#include <initializer_list>
 
 enum class ESampleType { 
 	PIECES,					//Most general case, kings in 3612 possible locations, up to 30 pieces picked 
 	PIECES_WB,				//White and black pieces picked separately
 	WB_RESTRICTED,			//White and black pieces picked separately, slowly calculates restricted case. For validation
-	RESTRICTED,				//Restricted case: no underpromotions, at most 3 queens per side
-	VERY_RESTRICTED		//Restricted case: no underpromotions, at most 1 queen per side
+	RESTRICTED,				//Restricted case, by default no underpromotions and at most 3 queens per side (--profile)
+	VERY_RESTRICTED		//RESTRICTED with the profile no underpromotions and at most 1 queen per side by default
 };
 
+constexpr std::array<const char*, 5> SAMPLE_TYPE_NAMES = { "PIECES", "PIECES_WB", "WB_RESTRICTED", "RESTRICTED", "VERY_RESTRICTED" };
+
 struct LegalParams;
+struct RestrictionProfile;
 
 
 struct Attacker
@@ -41,9 +48,13 @@ private:
 	Square bk = SQUARE_NB;							//Black king location
 	LegalParams* lp = nullptr;
 	std::array<int, PIECE_NB> count;				//Count of each piece type
-	std::array<int, PIECE_NB> maxcount;			//Max number of each piece types for restricted case
-	Position posWTM;									//White-to-move position for SF
-	Position posBTM;									//Black-to-move position for SF
+	LeanBoard board;									//Pieces as seen by the legality checks
+	mutable Position posWTM;						//White-to-move position for SF. Only built when needed (fen(), mate search)
+	mutable Position posBTM;						//Black-to-move position for SF
+	mutable bool sfPositionsSet = false;			//posWTM and posBTM match the current pieces
+	PackedPosition record;							//fromPacked: the record, mirrored if black was to move
+	bool fromRecord = false;						//posWTM is built from record, with its castling rights and en passant
+	bool boardSet = false;							//board (and SF positions if not leanBoard) match the current pieces
 	int threadNum = -1;								//Current thread number
 	int nTotal = -1;									//Total number of pieces
 	int nWhite = -1;									//Number of white pieces
@@ -56,31 +67,44 @@ private:
 	std::array<File, 14> preEnpassantsFrom;	//Black's previous possible en-passants (from)
 	std::array<File, 14> preEnpassantsTo;		//Black's previous possible en-passants (to)
 	int prevEPCount = -1;							//Count of black's previous possible en-passants
-	std::vector<Attacker> attackers;				//List of who checks white king (at most 2)
+	std::array<Attacker, 2> attackers;				//Who checks white king, the first nattacks are set (at most 2)
+	double sampleWeight = 1.0;						//How much the last prepared sample counts (probability of its pawn placement)
+	int stratum = -1;									//prepare<RESTRICTED/VERY_RESTRICTED> only draws combinations with this many non-king pieces if >= 0
+	const RestrictionProfile* drawnFrom = nullptr;	//The piece counts were drawn from this profile's combinations, so they are within its caps
+	ERule rejectedBy = RULE_NB;						//Rule that rejected the last checkConditions, RULE_NB if it passed
 
 public:
 	[[nodiscard]] int getKingInPawnSquares() const;
 	[[nodiscard]] std::pair<Square, Square> getKings() const;
 	[[nodiscard]] const std::array<int, PIECE_NB>& getCount() const;
+	[[nodiscard]] double getSampleWeight() const;
+	[[nodiscard]] ERule getRejectedBy() const;
 	void init(LegalParams* lpIn, int tnum);
+	void setStratum(int s);
 	bool prepareMate();
 	bool prepareMateVarious();
 	template<ESampleType sampleType>
 	bool prepare();
+	double placePieces();
 	void setKingInfo();
 	void createCounts();
 	[[nodiscard]] bool checkBySide() const;
 	[[nodiscard]] bool checkPawnRanks() const;
-	[[nodiscard]] bool checkAdditionalConditions(bool underpromotions, int maxQueensOneSide, int maxQueensTotal) const;
+	[[nodiscard]] bool checkAdditionalConditions(const RestrictionProfile& rp) const;
 	[[nodiscard]] bool checkCounts() const;
 	[[nodiscard]] bool checkConditions();
+	[[nodiscard]] bool checkRule(ERule rule);
+	void setBoard();
+	[[nodiscard]] bool checkAttacks();
 	void createTotalCounts();
-	void setSFPositions();
+	void setSFPositions() const;
+	void needSFPositions() const;
+	[[nodiscard]] Bitboard whiteKingCheckers() const;
+	[[nodiscard]] bool isBlackInCheck() const;
 	[[nodiscard]] Piece pieceOn(Square sq) const;
-	[[nodiscard]] bool checkPieces(const std::vector<std::pair<Square, Piece>>& pieces) const;
+	[[nodiscard]] bool checkPieces(std::initializer_list<std::pair<Square, Piece>> pieces) const;
 	[[nodiscard]] Piece pieceFR(File f, Rank r) const;
 	[[nodiscard]] bool checkBishops() const;
-	[[nodiscard]] bool pawnStructureOk(const std::vector<Square>& plist, Piece p) const;
 	[[nodiscard]] bool checkPawnStructures() const;
 	[[nodiscard]] bool checkSameFileAndCounts() const;
 	[[nodiscard]] int countEnPassantPossibilities() const;
@@ -95,7 +119,10 @@ public:
 	[[nodiscard]] int countCastling() const;
 	[[nodiscard]] int totalPieces() const;
 	void fromFen(const std::string& fen);
+	void fromPacked(const PackedPosition& pp);
+	void fromBoard(const std::array<Piece, SQUARE_NB>& placed, Bitboard occupied);
 	[[nodiscard]] std::string fen() const;
+	[[nodiscard]] const Position& position() const;
 	[[nodiscard]] bool isSanityCheck() const;
 	[[nodiscard]] bool isSanityCheck2() const;
 	[[nodiscard]] bool checkOpening(const OpeningLimit& ol) const;
@@ -1,8 +1,10 @@
 #include "LegalParams.h"
+#include "Options.h"
 #include "thread.h"
 #include "uci.h"
 #include <numeric>
 #include <fstream>
+#include <sstream>
 
 using std::vector;
 using std::cout;
@@ -17,9 +19,7 @@ void init();
 template<typename Treal>
 Treal LegalParams::realRand(Treal minv, Treal maxv) const
 {
-	std::uniform_real_distribution<Treal> distribution(minv, maxv);
-	Treal ret = distribution(rgensPCG[omp_get_thread_num()]);
-	return ret;
+	return minv + Treal(rbufs[omp_get_thread_num()].real()) * (maxv - minv);
 }
 
 template double LegalParams::realRand(double minv, double maxv) const;
@@ -59,6 +59,28 @@ void LegalParams::setupKingLocations()
 }
 
 
+//Symmetry 0-7 of the board: bit 0 mirrors the files, bit 1 the ranks, bit 2 swaps files and ranks
+Square LegalParams::transformSquare(Square sq, int symmetry)
+{
+	int f = file_of(sq), r = rank_of(sq);
+	if (symmetry & 1)
+		f = 7 - f;
+	if (symmetry & 2)
+		r = 7 - r;
+	if (symmetry & 4)
+		std::swap(f, r);
+	return make_square(File(f), Rank(r));
+}
+
+
+//Castling (white king on e1, black on e8) and a check by a rook that black may have just castled with (black king
+//on c8 or g8) are the only rules that don't look the same on the mirrored board (see check-symmetry)
+bool LegalParams::castlingRelevant(Square wk, Square bk)
+{
+	return wk == SQ_E1 || bk == SQ_E8 || bk == SQ_C8 || bk == SQ_G8;
+}
+
+
 void LegalParams::setupSF(int argc, char* argv[])
 {
 	CommandLine::init(argc, argv);
@@ -116,63 +138,70 @@ int LegalParams::pickRandomKnownSum(const vector<OneComb>& probs, double sum, co
 }
 
 
-int LegalParams::drawNumOfPieces() const
+int LegalParams::pickAlias(const AliasTable& table) const
 {
-	return pickRandomKnownSum(combs, combsSum, combsPartialSum);
+	return table.pick(rbufs[omp_get_thread_num()].next());
 }
 
 
-std::pair<int,int> LegalParams::drawNumOfWBPieces() const
+int LegalParams::drawNumOfPieces() const
 {
-	int v = pickRandomKnownSum(combsWB, combsSumWB, combsWBPartialSum);
-	return std::make_pair(v / 16, v % 16);
+	return pickAlias(localTable(aliasCombs, &NodeTables::aliasCombs));
 }
 
-//Returns [wp, bp, wn, bn, wb, bb, wr, br, wq, bq]
-std::tuple<int, int, int, int, int, int, int, int, int, int> LegalParams::drawNumRestricted(int kingsInPawnSquares) const
+
+std::pair<int,int> LegalParams::drawNumOfWBPieces() const
 {
-	//Not very efficient but it doesn't matter because random number generation takes up 80% of time
-	int v = pickRandomKnownSum(combsRestricted, combsSumRestricted, combsRestrictedPartialSum);
-	int wp = v / (4 * 4 * 3 * 3 * 3 * 3 * 3 * 3 * 9);
-	int bp = v / (4 * 4 * 3 * 3 * 3 * 3 * 3 * 3) % 9;
-	int wn = v / (4 * 4 * 3 * 3 * 3 * 3 * 3) % 3;
-	int bn = v / (4 * 4 * 3 * 3 * 3 * 3) % 3;
-	int wb = v / (4 * 4 * 3 * 3 * 3) % 3;
-	int bb = v / (4 * 4 * 3 * 3) % 3;
-	int wr = v / (4 * 4 * 3) % 3;
-	int br = v / (4 * 4) % 3;
-	int wq = v / 4  % 4;
-	int bq = v % 4;
-	return std::make_tuple(wp, bp, wn, bn, wb, bb, wr, br, wq, bq);
+	int v = pickAlias(localTable(aliasCombsWB, &NodeTables::aliasCombsWB));
+	return std::make_pair(v / 16, v % 16);
 }
 
 //Returns [wp, bp, wn, bn, wb, bb, wr, br, wq, bq]
-std::tuple<int, int, int, int, int, int, int, int, int, int> LegalParams::drawNumVeryRestricted(int kingsInPawnSquares) const
+std::array<int, 2 * PK_NB> LegalParams::drawNumRestricted(int kingsInPawnSquares, int stratum) const
 {
-	//Not very efficient but it doesn't matter because random number generation takes up 80% of time
-	int v = pickRandomKnownSum(combsVeryRestricted, combsSumVeryRestricted, combsVeryRestrictedPartialSum);
-	int wp = v / (2 * 2 * 3 * 3 * 3 * 3 * 3 * 3 * 9);
-	int bp = v / (2 * 2 * 3 * 3 * 3 * 3 * 3 * 3) % 9;
-	int wn = v / (2 * 2 * 3 * 3 * 3 * 3 * 3) % 3;
-	int bn = v / (2 * 2 * 3 * 3 * 3 * 3) % 3;
-	int wb = v / (2 * 2 * 3 * 3 * 3) % 3;
-	int bb = v / (2 * 2 * 3 * 3) % 3;
-	int wr = v / (2 * 2 * 3) % 3;
-	int br = v / (2 * 2) % 3;
-	int wq = v / 2 % 2;
-	int bq = v % 2;
-	return std::make_tuple(wp, bp, wn, bn, wb, bb, wr, br, wq, bq);
+	if (stratum >= 0)
+		return profile.caps.decode(localTable(strataRestricted, &NodeTables::strataRestricted).pick(stratum, rbufs[omp_get_thread_num()].next()));
+	return profile.caps.decode(pickAlias(localTable(aliasRestricted, &NodeTables::aliasRestricted)));
 }
 
-void LegalParams::setup(int argc, char* argv[], int nthreads)
+bool LegalParams::setup(int argc, char* argv[], int nthreads)
 {
-	vector<int> slist(omp_get_max_threads(), 12941865);
-	vector<uint32_t> seeds(slist.size());
-	std::seed_seq seq(slist.begin(), slist.end());
-	seq.generate(seeds.begin(), seeds.end());
-	rgensPCG.resize(omp_get_max_threads());
-	for (int x = 0; x < rgensPCG.size(); x++)
-		rgensPCG[x] = randGen(seeds[x]);
+	//Every thread of every shard gets its own random stream, so runs on different machines never repeat each other's samples
+	shard = std::stoi(optionValue(argc, argv, "--shard", "0"));
+	shards = std::stoi(optionValue(argc, argv, "--shards", "1"));
+	if (shards < 1 || shard < 0 || shard >= shards)
+	{
+		cout << "--shard must be from 0 to --shards - 1, got --shard " << shard << " --shards " << shards << endl;
+		return false;
+	}
+	if (std::max(nthreads, omp_get_max_threads()) > MAX_STREAMS_PER_SHARD)
+	{
+		cout << "At most " << MAX_STREAMS_PER_SHARD << " threads, otherwise the random streams overlap the next shard's" << endl;
+		return false;
+	}
+	//--profile: what RESTRICTED counts, the VERY_RESTRICTED profile by default for that sample type
+	const bool veryRestricted = optionValue(argc, argv, "--sample-type") == "VERY_RESTRICTED";
+	if (!RestrictionProfile::parse(optionValue(argc, argv, "--profile", veryRestricted ? "VERY_RESTRICTED" : "RESTRICTED"), profile))
+		return false;
+	//--profiles A,B,...: extra profiles, answered by the same samples
+	extraProfiles.clear();
+	std::stringstream profilesList(optionValue(argc, argv, "--profiles"));
+	for (std::string spec; std::getline(profilesList, spec, ',');)
+	{
+		if (!RestrictionProfile::parse(spec, extraProfiles.emplace_back()))
+			return false;
+	}
+	rgensPCG.clear();
+	rbufs.clear();
+	for (int x = 0; x < omp_get_max_threads(); x++)
+	{
+		rgensPCG.emplace_back(makeStreamGen<randGen>(SEED, shard, x, MAX_STREAMS_PER_SHARD));
+		rbufs.emplace_back(makeStreamGen<bufferGen>(SEED, shard, x, MAX_STREAMS_PER_SHARD));
+	}
+	ruleStats.clear();
+	for (int x = 0; x < omp_get_max_threads(); x++)
+		ruleStats.emplace_back();
+	adaptiveRuleOrder = hasOption(argc, argv, "--adaptive-order");
 
 	states.resize(nthreads);
 	states2.resize(nthreads);
@@ -186,57 +215,92 @@ void LegalParams::setup(int argc, char* argv[], int nthreads)
 
 	kingLocDistribution = std::uniform_int_distribution<int>(0, int(whiteKingLocs.size() - 1));
 
-	auto fsum = [](double sum, const OneComb& c2)
-	{
-		return sum + c2.val;
-	};
-	
-	auto readNumbers = [&](std::string fname, int sz)
+	//Sorted by size, with partial sums. The exact total of positions is printed, the sampling only needs doubles
+	auto prepareTable = [&](CombTable&& t, const std::string& name, std::vector<OneComb>& res, std::vector<double>& partialSum, double& total)
 	{
-		vector<OneComb> res(sz);
-		std::fstream myfile(fname, std::ios_base::in);
-		int idx = -1;
-		int count = 0;
-		while (myfile >> idx)
-		{
-			double v;
-			myfile >> v;
-			res[idx].idx = idx;
-			res[idx].val = v;
-			count++;
-		}
-
+		res = std::move(t.combs);
 		sort(res.begin(), res.end(), [](const OneComb& c1, const OneComb& c2) { return c1.val < c2.val; });
-		vector<double> partialSum(sz + 1);
+		partialSum.assign(res.size() + 1, 0);
 		double sum = 0;
-		for (int q = 0; q < sz; q++)
+		for (size_t q = 0; q < res.size(); q++)
 		{
 			partialSum[q] = sum;
 			sum += res[q].val;
 		}
-		partialSum[sz] = sum;
+		partialSum[res.size()] = sum;
+		total = sum;
 
-		return make_pair(res, partialSum);
+		BigInt positions = t.sum;
+		positions *= 2 * KING_COMBINATIONS;
+		cout << name << " Sample out of " << positions.toString() << " (" << total * 2.0 * KING_COMBINATIONS << ") unique possible pseudo-legal positions" << endl;
 	};
 
-	std::tie(combs, combsPartialSum) = readNumbers("combs.txt", 31);
-	std::tie(combsWB, combsWBPartialSum) = readNumbers("combsWB.txt", 16*16);
-	std::tie(combsRestricted, combsRestrictedPartialSum) = readNumbers("restricted.txt", 944774);
-	std::tie(combsVeryRestricted, combsVeryRestrictedPartialSum) = readNumbers("veryRestricted.txt", 236196);
+	prepareTable(piecesTable(), "PIECES", combs, combsPartialSum, combsSum);
+	prepareTable(piecesWBTable(), "PIECES_WB, WB_RESTRICTED", combsWB, combsWBPartialSum, combsSumWB);
+	prepareTable(cachedRestrictedTable(profile.caps), "RESTRICTED " + profile.name(), combsRestricted, combsRestrictedPartialSum, combsSumRestricted);
+
+	aliasCombs.build(combs);
+	aliasCombsWB.build(combsWB);
+	aliasRestricted.build(combsRestricted);
+
+	stratified = hasOption(argc, argv, "--stratified");
+	reproducible = hasOption(argc, argv, "--reproducible");
+	if (stratified)
+		setupStrata();
+	return true;
+}
+
+
+//The main profile, then the extra ones. For example P8N2B2R2Q3+P8N2B2R2Q1+P8N2B2R2Q2
+std::string LegalParams::profilesName() const
+{
+	std::string res = profile.name();
+	for (const auto& rp : extraProfiles)
+		res += "+" + rp.name();
+	return res;
+}
 
-	combsSum = std::accumulate(combs.begin(), combs.end(), 0.0, fsum);
-	cout << "PIECES Sample out of " << combsSum * 2.0 * KING_COMBINATIONS << " unique possible pseudo-legal positions" << endl;
 
-	combsSumWB = std::accumulate(combsWB.begin(), combsWB.end(), 0.0, fsum);
-	cout << "PIECES_WB, WB_RESTRICTED Sample out of " << combsSumWB * 2.0 * KING_COMBINATIONS << " unique possible pseudo-legal positions" << endl;
+void LegalParams::setupStrata()
+{
+	auto piecesOf = [](const std::array<int, 2 * PK_NB>& counts)
+	{
+		return std::accumulate(counts.begin(), counts.end(), 0);
+	};
+	strataRestricted.build(combsRestricted, [&](int v) { return piecesOf(profile.caps.decode(v)); });
+}
+
+//--numa: the node and CPU of every thread, and room for a copy of the alias tables on each node
+void LegalParams::setupNuma(int nthreads)
+{
+	numa = NumaTopology::detect();
+	numa.assign(nthreads);
+	nodeTables.assign(numa.nodes(), NodeTables());
+	threadTables.resize(nthreads);
+	for (int t = 0; t < nthreads; t++)
+		threadTables[t] = &nodeTables[numa.threadNode[t]];
+}
 
-	combsSumRestricted = std::accumulate(combsRestricted.begin(), combsRestricted.end(), 0.0, fsum);
-	cout << "RESTRICTED Sample out of " << combsSumRestricted * 2.0 * KING_COMBINATIONS << " unique possible pseudo-legal positions" << endl;
 
-	combsSumVeryRestricted = std::accumulate(combsVeryRestricted.begin(), combsVeryRestricted.end(), 0.0, fsum);
-	cout << "VERY_RESTRICTED Sample out of " << combsSumVeryRestricted * 2.0 * KING_COMBINATIONS << " unique possible pseudo-legal positions" << endl;
+//--numa: run by every sampling thread before its first sample. Pins the thread and brings what it uses to its node. Memory
+//pages go to the node of the thread that writes them first, so the first thread of each node copies the sampling tables,
+//and every thread reallocates its random streams, rule telemetry and SF states. The threads must wait for each other
+//before sampling. False if the thread couldn't be pinned
+bool LegalParams::placeThread(int tnum)
+{
+	const int node = numa.threadNode[tnum];
+	const bool ok = numa.pinThread(tnum);
+	if (tnum == 0 || numa.threadNode[tnum - 1] != node)
+		nodeTables[node] = NodeTables{ aliasCombs, aliasCombsWB, aliasRestricted, strataRestricted };
+	rbufs.place(tnum);
+	rgensPCG.place(tnum);
+	ruleStats.place(tnum);
+	states[tnum] = std::make_unique<std::deque<StateInfo>>(1);
+	states2[tnum] = std::make_unique<std::deque<StateInfo>>(1);
+	return ok;
 }
 
+
 void LegalParams::makePartialNormal()
 {
 	combsNormal.resize(5);
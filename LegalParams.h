@@ -7,7 +7,16 @@
 #include "random/jsf.hpp"
 #include "random/gjrand.hpp"
 #include "random/xoroshiro.hpp"
-#include "random/jsf.hpp"
+#include "random/sfc.hpp"
+#include "random/xoshiro256simd.hpp"
+#include "AliasTable.h"
+#include "CombTables.h"
+#include "Numa.h"
+#include "PerThread.h"
+#include "RestrictionProfile.h"
+#include "RandBuffer.h"
+#include "RuleStats.h"
+#include "Strata.h"
 #include <omp.h>
 
 struct OneComb
@@ -20,15 +29,50 @@ struct OneComb
 using randGen = pcg64;		
 //using randGen = jsf64;		
 
+//Generator that fills the per-thread random buffers. Seeded from randGen
+using bufferGen = xoshiro256x8;
+//using bufferGen = randGen;
+//using bufferGen = jsf64;
+//using bufferGen = sfc64;
+//using bufferGen = xoroshiro128plus64;
+//using bufferGen = gjrand64;
+
+//Generator for thread `thread` of shard `shard`. pcg64 (stream selection) and xoshiro256x8 (jumps) streams
+//never overlap; other generators are seeded from a pcg64 stream
+template<typename TGen>
+[[nodiscard]] TGen makeStreamGen(uint64_t seed, int shard, int thread, int threadsPerShard)
+{
+	const uint64_t stream = uint64_t(shard) * threadsPerShard + thread;
+	if constexpr (requires { TGen::fromStream(seed, uint64_t(shard), uint64_t(thread)); })
+		return TGen::fromStream(seed, uint64_t(shard), uint64_t(thread));
+	else if constexpr (std::is_same_v<TGen, pcg64>)
+		return pcg64(seed, stream);
+	else
+		return TGen(uint64_t(pcg64(seed, stream)()));
+}
+
+
+//The tables every sample draws its piece counts from, copied to one NUMA node (--numa)
+struct NodeTables
+{
+	AliasTable aliasCombs, aliasCombsWB, aliasRestricted;
+	Strata strataRestricted;
+};
+
+
 struct LegalParams
 {
 	const int KING_COMBINATIONS = 3612;
+	static constexpr uint64_t SEED = 12941865;
+	static constexpr int MAX_STREAMS_PER_SHARD = 1024;					//Threads of one shard
+	static constexpr int MAX_DRAWS_PER_SAMPLE = 64;		//prepare() needs at most: piece counts + 30 pieces + kings + 30 squares
 	static const inline std::vector<Piece> chooseFrom = 
 		{ W_PAWN, W_BISHOP, W_KNIGHT, W_ROOK, W_QUEEN, B_PAWN, B_BISHOP, B_KNIGHT, B_ROOK, B_QUEEN };
 
 	std::vector<Square> whiteKingLocs, blackKingLocs;				//King locations
 	std::vector<StateListPtr> states, states2;						//Stockfish states
-	mutable std::vector<randGen> rgensPCG;								//Random number generators, one per thread
+	mutable PerThread<randGen> rgensPCG;								//Random number generators, one per thread
+	mutable PerThread<RandBuffer<bufferGen>> rbufs;					//Buffered random words all the sampling draws come from, one per thread
 	std::vector<OneComb> combs;
 	std::vector<double> combsPartialSum;
 	double combsSum = -1;
@@ -38,20 +82,37 @@ struct LegalParams
 	int bothInPawnsField = -1;
 	int oneInPawnsField = -1;
 	int noneInPawnsField = -1;
-	std::vector<OneComb> combsRestricted, combsVeryRestricted;
-	std::vector<double> combsRestrictedPartialSum, combsVeryRestrictedPartialSum;
-	double combsSumRestricted = -1, combsSumVeryRestricted = -1;
+	RestrictionProfile profile;											//What the restricted counts and sample types are restricted to (--profile)
+	std::vector<RestrictionProfile> extraProfiles;					//More profiles every legal sample is checked against, each with its own count (--profiles)
+	std::vector<OneComb> combsRestricted;								//Combinations of piece counts within the profile
+	std::vector<double> combsRestrictedPartialSum;
+	double combsSumRestricted = -1;
 	std::uniform_int_distribution<int> kingLocDistribution;
 	const double kingsMult = 1.0 / KING_COMBINATIONS;
 	std::vector<double> partialNormal;
 	std::vector<OneComb> combsNormal;
 	std::vector<double> partialNormalExt;
 	std::vector<OneComb> combsNormalExt;
+	AliasTable aliasCombs, aliasCombsWB, aliasRestricted;			//O(1) samplers over the same combinations
+	Strata strataRestricted;												//The same combinations by number of pieces, for --stratified
+	bool stratified = false;											//RESTRICTED and VERY_RESTRICTED draw the strata by Neyman allocation (--stratified)
+	bool leanBoard = true;												//Legality checks use LeanBoard. Otherwise they build full SF positions for every sample
+	mutable PerThread<RuleStats> ruleStats;						//Rule telemetry and rule order, one per thread
+	int shard = 0;															//Which of the processes sampling the same estimate this is (--shard)
+	int shards = 1;															//Number of processes sampling the same estimate (--shards)
+	bool adaptiveRuleOrder = false;									//Reorder the rules by rejections per cycle (--adaptive-order)
+	int64_t ruleWarmup = 1 << 20;										//Checked samples before a thread reorders its rules. Redone every ruleWarmup samples
+	bool reproducible = false;											//Every sample draws from a counter-based stream of its index in the shard (--reproducible)
+	NumaTopology numa;													//--numa: the nodes, and the node and CPU of each thread
+	std::vector<NodeTables> nodeTables;								//--numa: a copy of the alias tables on each node, made by placeThread
+	std::vector<const NodeTables*> threadTables;					//--numa: the copy each thread draws from. Empty without --numa
 
 
 	template<typename Treal> 
 	[[nodiscard]] Treal realRand(Treal minv, Treal maxv) const;
 	void setupKingLocations();
+	[[nodiscard]] static Square transformSquare(Square sq, int symmetry);
+	[[nodiscard]] static bool castlingRelevant(Square wk, Square bk);
 	void setupSF(int argc, char* argv[]);
 	[[nodiscard]] Piece pickPiece(int tnum) const;
 	[[nodiscard]] Piece pickWPiece(int tnum) const;
@@ -59,12 +120,16 @@ struct LegalParams
 	[[nodiscard]] Piece pickWPieceNoPawn(int tnum) const;
 	[[nodiscard]] Piece pickBPieceNotPawn(int tnum) const;
 	[[nodiscard]] int pickRandomKnownSum(const std::vector<OneComb>& probs, double sum, const std::vector<double>& partialSums) const;
-	void setup(int argc, char* argv[], int nthreads);
+	[[nodiscard]] int pickAlias(const AliasTable& table) const;
+	[[nodiscard]] bool setup(int argc, char* argv[], int nthreads);
+	[[nodiscard]] std::string profilesName() const;
+	void setupStrata();
+	void setupNuma(int nthreads);
+	[[nodiscard]] bool placeThread(int tnum);
 	//Inclusive
 	[[nodiscard]] inline int intRand(const int& minx, const int& maxx, int tnum) const
 	{
-		const std::uniform_int_distribution<int> distribution(minx, maxx);
-		return intRand(tnum, distribution);
+		return minx + int(rbufs[tnum].bounded(uint64_t(maxx - minx) + 1));
 	}
 	//Inclusive
 	[[nodiscard]] inline int intRand(const int& minx, const int& maxx) const
@@ -75,13 +140,33 @@ struct LegalParams
 	//Inclusive
 	[[nodiscard]] inline int intRand(int tnum, const std::uniform_int_distribution<int>& distribution) const
 	{
-		return distribution(rgensPCG[tnum]);
+		return intRand(distribution.a(), distribution.b(), tnum);
+	}
+
+	//The calling thread's copy of one of the sampling tables with --numa, the shared one otherwise
+	template<typename TTable>
+	[[nodiscard]] inline const TTable& localTable(const TTable& shared, TTable NodeTables::* copy) const
+	{
+		return threadTables.empty() ? shared : threadTables[omp_get_thread_num()]->*copy;
+	}
+
+	//Keep all the draws of one sample in one buffer block
+	inline void beginSample(int tnum) const
+	{
+		rbufs[tnum].reserve(MAX_DRAWS_PER_SAMPLE);
+	}
+
+	//--reproducible: thread tnum draws sample index of this shard next. Its draws only depend on SEED, the shard and index
+	inline void beginIndexedSample(int tnum, uint64_t index) const
+	{
+		static_assert(RandBuffer<bufferGen>::SAMPLE_WORDS >= MAX_DRAWS_PER_SAMPLE);
+		rbufs[tnum].startSample({ SEED, uint64_t(shard) }, index);
 	}
 
 	[[nodiscard]] int drawNumOfPieces() const;	//draw the number of non-king pieces given probabilities
 	[[nodiscard]] std::pair<int, int> drawNumOfWBPieces() const;
-	[[nodiscard]] std::tuple<int, int, int, int, int, int, int, int, int, int> drawNumRestricted(int kingsInPawnSquares) const;
-	[[nodiscard]] std::tuple<int, int, int, int, int, int, int, int, int, int> drawNumVeryRestricted(int kingsInPawnSquares) const;
+	//Only from the combinations with `stratum` non-king pieces if stratum >= 0
+	[[nodiscard]] std::array<int, 2 * PK_NB> drawNumRestricted(int kingsInPawnSquares, int stratum = -1) const;
 	void makePartialNormal();
 };
 
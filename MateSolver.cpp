@@ -0,0 +1,360 @@
+#include "MateSolver.h"
+#include "PackedPosition.h"
+#include "movegen.h"
+#include "thread.h"
+#include <omp.h>
+#include <algorithm>
+
+using std::vector;
+using std::string;
+
+
+MateSolver::MateSolver(size_t ttMegabytes)
+{
+	size_t buckets = 1;
+	while (buckets * 2 * BUCKET * sizeof(TTEntry) <= ttMegabytes * 1024 * 1024)
+		buckets *= 2;
+	table.assign(buckets * BUCKET, TTEntry());
+	bucketMask = buckets - 1;
+}
+
+
+void MateSolver::clear()
+{
+	std::fill(table.begin(), table.end(), TTEntry());
+	nodes = 0;
+}
+
+
+void MateSolver::setStop(const std::atomic<bool>* stopIn)
+{
+	stop = stopIn;
+}
+
+
+uint64_t MateSolver::getNodes() const
+{
+	return nodes;
+}
+
+
+//The same position is a different node for every number of moves left and for each side being the attacker
+uint64_t MateSolver::nodeKey(Key key, int movesLeft, bool defenderToMove)
+{
+	const uint64_t k = key ^ (uint64_t(2 * movesLeft + defenderToMove + 1) * 0x9E3779B97F4A7C15ull);
+	return k ? k : 1;
+}
+
+
+bool MateSolver::probe(uint64_t key, PnDn& res) const
+{
+	const TTEntry* bucket = &table[(key & bucketMask) * BUCKET];
+	for (int q = 0; q < BUCKET; q++)
+		if (bucket[q].key == key)
+		{
+			res = { bucket[q].pn, bucket[q].dn };
+			return true;
+		}
+	return false;
+}
+
+
+//Proofs and disproofs are kept over unfinished entries. Among these, the one with the smallest numbers is replaced
+void MateSolver::store(uint64_t key, PnDn v)
+{
+	TTEntry* bucket = &table[(key & bucketMask) * BUCKET];
+	TTEntry* replace = nullptr;
+	uint64_t replaceCost = UINT64_MAX;
+	for (int q = 0; q < BUCKET; q++)
+	{
+		TTEntry& e = bucket[q];
+		if (e.key == key || e.key == 0)
+		{
+			replace = &e;
+			break;
+		}
+		const uint64_t cost = e.pn == 0 || e.dn == 0 ? uint64_t(INF) * 2 + q : uint64_t(e.pn) + e.dn;
+		if (cost < replaceCost)
+		{
+			replaceCost = cost;
+			replace = &e;
+		}
+	}
+	*replace = { key, v.pn, v.dn };
+}
+
+
+//Does the checking move m mate? Stops at the first legal evasion
+static bool isCheckmate(Position& pos, Move m)
+{
+	StateInfo st;
+	pos.do_move(m, st);
+	ExtMove evasions[MAX_MOVES];
+	const ExtMove* last = generate<EVASIONS>(pos, evasions);
+	bool mate = true;
+	for (const ExtMove* e = evasions; e < last && mate; e++)
+		mate = !pos.legal(*e);
+	pos.undo_move(m);
+	return mate;
+}
+
+
+//Depth-first AND/OR search of the node, for the last EXACT_MOVES attacker moves where proof numbers don't pay off
+bool MateSolver::exact(Position& pos, int movesLeft, bool defenderToMove)
+{
+	nodes++;
+	const uint64_t key = nodeKey(pos.key(), movesLeft, defenderToMove);
+	PnDn known;
+	if (probe(key, known) && (known.pn == 0 || known.dn == 0))
+		return known.pn == 0;
+
+	ExtMove moves[MAX_MOVES];
+	ExtMove* last = generate<LEGAL>(pos, moves);
+	bool mate;
+	if (last == moves)
+		mate = defenderToMove && pos.checkers();
+	else if (defenderToMove)
+	{
+		//The reply that last refuted an attack with as many moves left is often a refutation here too
+		Move& killer = killers[movesLeft];
+		for (ExtMove* m = moves; m < last; m++)
+			if (*m == killer)
+			{
+				std::swap(*m, *moves);
+				break;
+			}
+		mate = movesLeft > 0;
+		for (ExtMove* m = moves; m < last && mate; m++)
+		{
+			StateInfo st;
+			pos.do_move(*m, st);
+			mate = exact(pos, movesLeft, false);
+			pos.undo_move(*m);
+			if (!mate)
+				killer = *m;
+		}
+	}
+	else
+	{
+		//Checks first. A mate in 1 is cheap to find, before any deeper line, and with one move left only a check can mate
+		ExtMove* checksEnd = moves;
+		for (ExtMove* m = moves; m < last; m++)
+			if (pos.gives_check(*m))
+				std::swap(*m, *checksEnd++);
+		mate = false;
+		for (ExtMove* m = moves; m < checksEnd && !mate; m++)
+			mate = isCheckmate(pos, *m);
+		for (ExtMove* m = moves; m < last && !mate && movesLeft > 1; m++)
+		{
+			StateInfo st;
+			pos.do_move(*m, st);
+			mate = exact(pos, movesLeft - 1, true);
+			pos.undo_move(*m);
+		}
+	}
+	store(key, mate ? PnDn{ 0, INF } : PnDn{ INF, 0 });
+	return mate;
+}
+
+
+//pn and dn of the node: the attacker to move (OR node) or the defender to move (AND node), with movesLeft attacker moves
+//left. Returns when the node is solved or one of its numbers reaches its threshold
+MateSolver::PnDn MateSolver::search(Position& pos, int movesLeft, bool defenderToMove, uint32_t thpn, uint32_t thdn)
+{
+	if (stop && stop->load(std::memory_order_relaxed))
+	{
+		aborted = true;
+		return { 1, 1 };
+	}
+	if (movesLeft <= EXACT_MOVES - defenderToMove)
+		return exact(pos, movesLeft, defenderToMove) ? PnDn{ 0, INF } : PnDn{ INF, 0 };
+	nodes++;
+	const uint64_t key = nodeKey(pos.key(), movesLeft, defenderToMove);
+
+	//The only move generation of the node. Checks are moved to the front, they are tried first on ties
+	ExtMove moves[MAX_MOVES];
+	ExtMove* last = generate<LEGAL>(pos, moves);
+	int n = int(last - moves);
+	if (n == 0)
+	{
+		const PnDn res = defenderToMove && pos.checkers() ? PnDn{ 0, INF } : PnDn{ INF, 0 };
+		store(key, res);
+		return res;
+	}
+	if (defenderToMove && movesLeft == 0)
+	{
+		store(key, { INF, 0 });
+		return { INF, 0 };
+	}
+
+	std::array<uint32_t, MAX_MOVES> pn, dn;
+	if (!defenderToMove)
+	{
+		int checks = 0;
+		for (int q = 0; q < n; q++)
+			if (pos.gives_check(moves[q]))
+				std::swap(moves[q], moves[checks++]);
+		for (int q = 0; q < n; q++)
+		{
+			PnDn v;
+			if (!probe(nodeKey(pos.key_after(moves[q]), movesLeft - 1, true), v))
+				v = { q < checks ? 1u : 2u, 1 };		//Checks look closer to a proof
+			pn[q] = v.pn;
+			dn[q] = v.dn;
+		}
+	}
+	else
+		for (int q = 0; q < n; q++)
+		{
+			PnDn v;
+			if (!probe(nodeKey(pos.key_after(moves[q]), movesLeft, false), v))
+				v = { 1, 1 };
+			pn[q] = v.pn;
+			dn[q] = v.dn;
+		}
+
+	//OR node: pn is the smallest child pn and dn the sum of the child dns. AND node: the other way around
+	uint32_t* const mins = defenderToMove ? dn.data() : pn.data();
+	uint32_t* const sums = defenderToMove ? pn.data() : dn.data();
+	const uint32_t thMin = defenderToMove ? thdn : thpn;
+	const uint32_t thSum = defenderToMove ? thpn : thdn;
+	PnDn res;
+	while (true)
+	{
+		int best = 0;
+		uint32_t min1 = INF, min2 = INF;
+		uint64_t sum = 0;
+		for (int q = 0; q < n; q++)
+		{
+			sum += sums[q];
+			if (mins[q] < min1)
+			{
+				min2 = min1;
+				min1 = mins[q];
+				best = q;
+			}
+			else if (mins[q] < min2)
+				min2 = mins[q];
+		}
+		const uint32_t sumCapped = uint32_t(std::min<uint64_t>(sum, INF));
+		res = defenderToMove ? PnDn{ sumCapped, min1 } : PnDn{ min1, sumCapped };
+		if (min1 >= thMin || sumCapped >= thSum || min1 == 0 || aborted)
+			break;
+
+		//1+epsilon: the child may run until its number is a quarter past the second best, not just one past
+		const uint32_t childMin = uint32_t(std::min<uint64_t>(thMin, std::max<uint64_t>(uint64_t(min2) + 1, uint64_t(min2) + min2 / 4)));
+		const uint32_t childSum = uint32_t(std::min<uint64_t>(INF, uint64_t(thSum) - sumCapped + sums[best]));
+		StateInfo st;
+		pos.do_move(moves[best], st);
+		const PnDn child = defenderToMove ? search(pos, movesLeft, false, childSum, childMin)
+			: search(pos, movesLeft - 1, true, childMin, childSum);
+		pos.undo_move(moves[best]);
+		pn[best] = child.pn;
+		dn[best] = child.dn;
+	}
+
+	store(key, res);
+	return res;
+}
+
+
+bool MateSolver::solve(Position& pos, int movesLeft, bool defenderToMove)
+{
+	aborted = false;
+	const PnDn res = search(pos, movesLeft, defenderToMove, INF, INF);
+	return res.pn == 0 && !aborted;
+}
+
+
+bool MateSolver::isMate(Position& pos, int moves)
+{
+	return moves >= 1 && solve(pos, moves, false);
+}
+
+
+bool MateSolver::isMated(Position& pos, int moves)
+{
+	return moves >= 0 && solve(pos, moves, true);
+}
+
+
+bool searchableFen(const string& fen)
+{
+	PieceBoard placed;
+	Bitboard occupied;
+	bool blackToMove = false;
+	const char* p = fen.data();
+	const char* end = p + fen.size();
+	if (!parseFenBoard(p, end, placed, occupied, blackToMove))
+		return false;
+	for (Bitboard b = occupied & (Rank1BB | Rank8BB); b; )
+		if (type_of(placed[pop_lsb(&b)]) == PAWN)
+			return false;
+
+	//Set looks for the rook of each castling right along the first rank, and runs off the board if it isn't there
+	auto skipField = [&]()
+	{
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		while (p < end && *p != ' ' && *p != '\t')
+			p++;
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+	};
+	skipField();			//Board
+	skipField();			//Side to move
+	for (; p < end && *p != ' ' && *p != '\t' && *p != '-'; p++)
+	{
+		if (*p != 'K' && *p != 'Q' && *p != 'k' && *p != 'q')
+			return false;
+		const Color c = *p == 'K' || *p == 'Q' ? WHITE : BLACK;
+		const Square king = relative_square(c, SQ_E1);
+		const Square rook = relative_square(c, *p == 'K' || *p == 'k' ? SQ_H1 : SQ_A1);
+		if (!(occupied & king) || placed[king] != make_piece(c, KING) || !(occupied & rook) || placed[rook] != make_piece(c, ROOK))
+			return false;
+	}
+
+	StateInfo st;
+	Position pos;
+	pos.set(fen, false, &st, Threads.main());
+	return !(pos.attackers_to(pos.square<KING>(~pos.side_to_move())) & pos.pieces(pos.side_to_move()));
+}
+
+
+bool isMateRootSplit(const string& fen, int moves, vector<MateSolver>& solvers)
+{
+	if (moves < 1)
+		return false;
+	vector<Move> rootMoves;
+	{
+		StateInfo st;
+		Position pos;
+		pos.set(fen, false, &st, Threads.main());
+		for (const auto& m : MoveList<LEGAL>(pos))
+			rootMoves.push_back(m.move);
+		std::stable_partition(rootMoves.begin(), rootMoves.end(), [&](Move m) { return pos.gives_check(m); });
+	}
+
+	std::atomic<bool> found = false;
+#pragma omp parallel num_threads(int(solvers.size()))
+	{
+		MateSolver& solver = solvers[omp_get_thread_num()];
+		solver.setStop(&found);
+		StateInfo rootState, moveState;
+		Position pos;
+		pos.set(fen, false, &rootState, Threads.main());
+
+#pragma omp for schedule(dynamic, 1)
+		for (int q = 0; q < int(rootMoves.size()); q++)
+		{
+			if (found.load(std::memory_order_relaxed))
+				continue;
+			pos.do_move(rootMoves[q], moveState);
+			if (solver.isMated(pos, moves - 1))
+				found = true;
+			pos.undo_move(rootMoves[q]);
+		}
+		solver.setStop(nullptr);
+	}
+	return found;
+}
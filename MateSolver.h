@@ -0,0 +1,69 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "position.h"
+
+
+//Depth-bounded df-pn (depth-first proof-number search) for mate in N. The attacker's nodes are OR nodes and the
+//defender's AND nodes, and every node is a position plus the attacker moves left. Each node generates its moves once,
+//keeps its children's proof and disproof numbers locally and only re-enters the most proving child, with the 1+epsilon
+//trick to avoid thrashing between siblings. A transposition table keyed on the Zobrist key (st->key), the moves left and
+//the node type seeds the children's numbers and keeps every proof and disproof. One solver per thread
+class MateSolver
+{
+private:
+	struct TTEntry
+	{
+		uint64_t key = 0;						//0 = empty
+		uint32_t pn = 0;
+		uint32_t dn = 0;
+	};
+
+	struct PnDn
+	{
+		uint32_t pn;
+		uint32_t dn;
+	};
+
+	static constexpr uint32_t INF = 1u << 30;
+	static constexpr int BUCKET = 4;				//Entries per bucket, a cache line
+	static constexpr int EXACT_MOVES = 2;			//Nodes with at most this many attacker moves left are searched depth-first
+
+	std::vector<TTEntry> table;
+	uint64_t bucketMask = 0;
+	uint64_t nodes = 0;
+	const std::atomic<bool>* stop = nullptr;		//Abandon the search when set
+	bool aborted = false;
+	std::array<Move, MAX_PLY> killers{};			//Last refutation of the defender, by attacker moves left
+
+	[[nodiscard]] static uint64_t nodeKey(Key key, int movesLeft, bool defenderToMove);
+	[[nodiscard]] bool probe(uint64_t key, PnDn& res) const;
+	void store(uint64_t key, PnDn v);
+	[[nodiscard]] bool exact(Position& pos, int movesLeft, bool defenderToMove);
+	[[nodiscard]] PnDn search(Position& pos, int movesLeft, bool defenderToMove, uint32_t thpn, uint32_t thdn);
+	[[nodiscard]] bool solve(Position& pos, int movesLeft, bool defenderToMove);
+
+public:
+	explicit MateSolver(size_t ttMegabytes = 64);
+	void clear();
+	void setStop(const std::atomic<bool>* stopIn);
+	[[nodiscard]] uint64_t getNodes() const;
+
+	//Can the side to move mate in at most moves moves? pos is restored
+	[[nodiscard]] bool isMate(Position& pos, int moves);
+	//Is the side to move mated in at most moves moves of the opponent (0: is it mated now)? pos is restored
+	[[nodiscard]] bool isMated(Position& pos, int moves);
+};
+
+
+//Can fen be searched? Position::set trusts its input: the board must pass parseFenBoard, have no pawns on the first or
+//last rank, castle only with the king and rook on their squares, and leave the side not to move out of check
+[[nodiscard]] bool searchableFen(const std::string& fen);
+
+//isMate split at the root over one thread per solver, for deep problems: every root move is a separate isMated search,
+//and the first proof stops the others
+[[nodiscard]] bool isMateRootSplit(const std::string& fen, int moves, std::vector<MateSolver>& solvers);
@@ -0,0 +1,206 @@
+#include "Numa.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <thread>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <linux/mempolicy.h>
+#include <filesystem>
+#include <fstream>
+#endif
+
+using std::vector;
+using std::string;
+
+
+#ifdef __linux__
+//"0-3,8,10-11" as in cpulist files
+static vector<int> parseCpuList(const string& list)
+{
+	vector<int> cpus;
+	size_t pos = 0;
+	while (pos < list.size() && isdigit(static_cast<unsigned char>(list[pos])))
+	{
+		size_t len = 0;
+		const int first = std::stoi(list.substr(pos), &len);
+		pos += len;
+		int last = first;
+		if (pos < list.size() && list[pos] == '-')
+		{
+			last = std::stoi(list.substr(pos + 1), &len);
+			pos += len + 1;
+		}
+		for (int cpu = first; cpu <= last; cpu++)
+			cpus.push_back(cpu);
+		if (pos < list.size() && list[pos] == ',')
+			pos++;
+	}
+	return cpus;
+}
+#endif
+
+
+NumaTopology NumaTopology::detect()
+{
+	NumaTopology t;
+#ifdef _WIN32
+	//A CPU is its processor group * 64 + its bit in the group's mask
+	ULONG highest = 0;
+	if (GetNumaHighestNodeNumber(&highest))
+	{
+		for (ULONG node = 0; node <= highest; node++)
+		{
+			GROUP_AFFINITY ga;
+			if (!GetNumaNodeProcessorMaskEx(USHORT(node), &ga))
+				continue;
+			vector<int> cpus;
+			for (int b = 0; b < 64; b++)
+				if ((ga.Mask >> b) & 1)
+					cpus.push_back(ga.Group * 64 + b);
+			if (cpus.empty())
+				continue;
+			t.nodeIds.push_back(int(node));
+			t.nodeCpus.push_back(cpus);
+		}
+	}
+#elif defined(__linux__)
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			CPU_SET(cpu, &allowed);
+
+	vector<std::pair<int, vector<int>>> found;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec))
+	{
+		const string name = entry.path().filename().string();
+		if (name.size() <= 4 || name.compare(0, 4, "node") != 0
+			|| !std::all_of(name.begin() + 4, name.end(), [](char c) { return isdigit(static_cast<unsigned char>(c)) != 0; }))
+			continue;
+		std::ifstream f(entry.path() / "cpulist");
+		string list;
+		std::getline(f, list);
+		vector<int> cpus;
+		for (int cpu : parseCpuList(list))
+			if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+				cpus.push_back(cpu);
+		if (!cpus.empty())
+			found.emplace_back(std::stoi(name.substr(4)), cpus);
+	}
+	std::sort(found.begin(), found.end());
+	for (auto& [id, cpus] : found)
+	{
+		t.nodeIds.push_back(id);
+		t.nodeCpus.push_back(std::move(cpus));
+	}
+
+	if (t.nodeIds.empty())
+	{
+		vector<int> cpus;
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &allowed))
+				cpus.push_back(cpu);
+		t.nodeIds.push_back(0);
+		t.nodeCpus.push_back(cpus);
+	}
+#endif
+	if (t.nodeIds.empty())
+	{
+		vector<int> cpus(std::max(1u, std::thread::hardware_concurrency()));
+		for (int cpu = 0; cpu < int(cpus.size()); cpu++)
+			cpus[cpu] = cpu;
+		t.nodeIds.push_back(0);
+		t.nodeCpus.push_back(cpus);
+	}
+	return t;
+}
+
+
+void NumaTopology::assign(int nthreads)
+{
+	size_t totalCpus = 0;
+	for (const auto& cpus : nodeCpus)
+		totalCpus += cpus.size();
+
+	threadNode.assign(nthreads, 0);
+	threadCpu.assign(nthreads, 0);
+	size_t cpusBefore = 0;
+	for (int node = 0; node < nodes(); node++)
+	{
+		const int first = int(cpusBefore * nthreads / totalCpus);
+		cpusBefore += nodeCpus[node].size();
+		const int last = int(cpusBefore * nthreads / totalCpus);
+		for (int tnum = first; tnum < last; tnum++)
+		{
+			threadNode[tnum] = node;
+			threadCpu[tnum] = nodeCpus[node][(tnum - first) % nodeCpus[node].size()];
+		}
+	}
+}
+
+
+int NumaTopology::nodes() const
+{
+	return int(nodeIds.size());
+}
+
+
+string NumaTopology::describe(int node) const
+{
+	const int threads = int(std::count(threadNode.begin(), threadNode.end(), node));
+	return "node " + std::to_string(nodeIds[node]) + " (" + std::to_string(nodeCpus[node].size()) + " CPUs, "
+		+ std::to_string(threads) + " threads)";
+}
+
+
+bool NumaTopology::pinThread(int tnum) const
+{
+	const int cpu = threadCpu[tnum];
+#ifdef _WIN32
+	GROUP_AFFINITY ga = {};
+	ga.Group = WORD(cpu / 64);
+	ga.Mask = KAFFINITY(1) << (cpu % 64);
+	return SetThreadGroupAffinity(GetCurrentThread(), &ga, nullptr) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+
+bool NumaTopology::moveToNode(const void* p, size_t bytes, int node) const
+{
+#ifdef __linux__
+	if (bytes == 0)
+		return true;
+	const uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+	const uintptr_t first = uintptr_t(p) & ~(pageSize - 1);
+	const uintptr_t last = (uintptr_t(p) + bytes - 1) & ~(pageSize - 1);
+	vector<void*> pages;
+	for (uintptr_t a = first; a <= last; a += pageSize)
+		pages.push_back(reinterpret_cast<void*>(a));
+	vector<int> nodes(pages.size(), nodeIds[node]);
+	vector<int> status(pages.size(), -1);
+	//Kernels before 4.17 return 0 even if some pages didn't move, only their status says so
+	if (syscall(SYS_move_pages, 0, pages.size(), pages.data(), nodes.data(), status.data(), MPOL_MF_MOVE) != 0)
+		return false;
+	return std::all_of(status.begin(), status.end(), [&](int s) { return s == nodeIds[node]; });
+#else
+	(void)p;
+	(void)bytes;
+	(void)node;
+	return false;
+#endif
+}
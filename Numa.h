@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+//NUMA nodes with CPUs this process may run on, and where the sampling threads go. From /sys/devices/system/node on
+//Linux and the processor groups on Windows. Elsewhere, one node and no pinning
+struct NumaTopology
+{
+	std::vector<int> nodeIds;								//OS number of each node
+	std::vector<std::vector<int>> nodeCpus;				//CPUs of each node this process may use
+	std::vector<int> threadNode;							//Node of each thread, set by assign
+	std::vector<int> threadCpu;							//CPU each thread is pinned to, set by assign
+
+	[[nodiscard]] static NumaTopology detect();
+	//Every node gets a contiguous range of threads in proportion to its CPUs, so neighboring per-thread data is mostly
+	//on the same node
+	void assign(int nthreads);
+	[[nodiscard]] int nodes() const;
+	[[nodiscard]] std::string describe(int node) const;
+	//Pins the calling thread to threadCpu[tnum]. False if that isn't possible here
+	bool pinThread(int tnum) const;
+	//Moves the memory pages of [p, p + bytes) to node. Pages shared with other data move too. False if the OS can't
+	[[nodiscard]] bool moveToNode(const void* p, size_t bytes, int node) const;
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+
+//Command line options are "--name" flags or "--name value" pairs anywhere after the subcommand
+[[nodiscard]] inline bool hasOption(int argc, char* argv[], const std::string& name)
+{
+	for (int q = 1; q < argc; q++)
+		if (name == argv[q])
+			return true;
+	return false;
+}
+
+
+[[nodiscard]] inline std::string optionValue(int argc, char* argv[], const std::string& name, const std::string& defaultValue = "")
+{
+	for (int q = 1; q + 1 < argc; q++)
+		if (name == argv[q])
+			return argv[q + 1];
+	return defaultValue;
+}
@@ -0,0 +1,221 @@
+#include "PackedPosition.h"
+#include "uci.h"
+#include <cstring>
+
+using std::string;
+
+
+PackedPosition PackedPosition::pack(const Position& pos)
+{
+	CodeBoard board;
+	for (Bitboard b = pos.pieces(); b; )
+	{
+		const Square sq = pop_lsb(&b);
+		board[sq] = uint8_t(pos.piece_on(sq));
+	}
+	for (CastlingRights cr : { WHITE_OO, WHITE_OOO, BLACK_OO, BLACK_OOO })
+		if (pos.can_castle(cr))
+			board[pos.castling_rook_square(cr)] = CASTLING_ROOK;
+	if (pos.ep_square() != SQ_NONE)
+		board[pos.ep_square() + (pos.side_to_move() == WHITE ? SOUTH : NORTH)] = EP_PAWN;
+	if (pos.side_to_move() == BLACK)
+		board[pos.square<KING>(BLACK)] = BLACK_KING_TO_MOVE;
+	return fromCodes(pos.pieces(), board);
+}
+
+
+#if defined(USE_PEXT)
+static const uint64_t LOW_NIBBLES = 0x0F0F0F0F0F0F0F0FULL;		//The code in each byte of a CodeBoard
+static const uint64_t NIBBLE_ONES = 0x1111111111111111ULL;
+
+//16 squares at a time: pext squeezes their bytes into nibbles, then the nibbles of the occupied ones together, and
+//they go into the 128-bit code stream. No loop over the pieces
+PackedPosition PackedPosition::fromCodes(uint64_t occupiedIn, const CodeBoard& board)
+{
+	PackedPosition pp;
+	pp.occupied = occupiedIn;
+	uint64_t stream[2] = { 0, 0 };
+	int pos = 0;
+	for (int chunk = 0; chunk < 4; chunk++)
+	{
+		uint64_t lo, hi;
+		std::memcpy(&lo, &board[16 * chunk], 8);
+		std::memcpy(&hi, &board[16 * chunk + 8], 8);
+		const uint64_t nibbles = _pext_u64(lo, LOW_NIBBLES) | (_pext_u64(hi, LOW_NIBBLES) << 32);
+		const uint64_t occ = (occupiedIn >> (16 * chunk)) & 0xFFFF;
+		const uint64_t bits = _pext_u64(nibbles, _pdep_u64(occ, NIBBLE_ONES) * 15);
+		if (pos < 64)
+		{
+			stream[0] |= bits << pos;
+			if (pos > 0)
+				stream[1] |= bits >> (64 - pos);
+		}
+		else
+			stream[1] |= bits << (pos - 64);
+		pos += 4 * popcount(occ);
+	}
+	std::memcpy(pp.codes.data(), stream, sizeof(stream));
+	return pp;
+}
+
+
+//The reverse of fromCodes: pdep spreads the nibbles of 16 squares to their places, then to bytes
+void PackedPosition::toCodes(CodeBoard& board) const
+{
+	uint64_t stream[2];
+	std::memcpy(stream, codes.data(), sizeof(stream));
+	int pos = 0;
+	for (int chunk = 0; chunk < 4; chunk++)
+	{
+		const uint64_t occ = (occupied >> (16 * chunk)) & 0xFFFF;
+		uint64_t bits = pos < 64 ? (stream[0] >> pos) | (pos > 0 ? stream[1] << (64 - pos) : 0) : stream[1] >> (pos - 64);
+		const uint64_t nibbles = _pdep_u64(bits, _pdep_u64(occ, NIBBLE_ONES) * 15);
+		const uint64_t lo = _pdep_u64(nibbles, LOW_NIBBLES), hi = _pdep_u64(nibbles >> 32, LOW_NIBBLES);
+		std::memcpy(&board[16 * chunk], &lo, 8);
+		std::memcpy(&board[16 * chunk + 8], &hi, 8);
+		pos += 4 * popcount(occ);
+	}
+}
+#else
+PackedPosition PackedPosition::fromCodes(uint64_t occupiedIn, const CodeBoard& board)
+{
+	PackedPosition pp;
+	pp.occupied = occupiedIn;
+	int n = 0;
+	for (Bitboard b = occupiedIn; b; n++)
+	{
+		const Square sq = pop_lsb(&b);
+		pp.codes[n / 2] |= uint8_t((board[sq] & 15) << (4 * (n % 2)));
+	}
+	return pp;
+}
+
+
+void PackedPosition::toCodes(CodeBoard& board) const
+{
+	board.fill(0);
+	int n = 0;
+	for (Bitboard b = occupied; b; n++)
+		board[pop_lsb(&b)] = (codes[n / 2] >> (4 * (n % 2))) & 15;
+}
+#endif
+
+
+string PackedPosition::fen() const
+{
+	std::array<Piece, SQUARE_NB> board;
+	board.fill(NO_PIECE);
+	Color stm = WHITE;
+	string ep = "-";
+	std::array<bool, 4> castling = {};			//KQkq
+
+	CodeBoard codeBoard;
+	toCodes(codeBoard);
+	for (Bitboard b = occupied; b; )
+	{
+		const Square sq = pop_lsb(&b);
+		const uint8_t c = codeBoard[sq];
+		const bool whiteHalf = rank_of(sq) <= RANK_4;
+		board[sq] = piece(c, sq);
+		if (c == CASTLING_ROOK)
+			castling[(whiteHalf ? 0 : 2) + (file_of(sq) == FILE_A ? 1 : 0)] = true;
+		else if (c == EP_PAWN)
+			ep = UCI::square(whiteHalf ? sq + SOUTH : sq + NORTH);
+		else if (c == BLACK_KING_TO_MOVE)
+			stm = BLACK;
+	}
+
+	string res;
+	for (Rank r = RANK_8; r >= RANK_1; --r)
+	{
+		int empty = 0;
+		for (File f = FILE_A; f <= FILE_H; ++f)
+		{
+			const Piece p = board[make_square(f, r)];
+			if (p == NO_PIECE)
+			{
+				empty++;
+				continue;
+			}
+			if (empty)
+				res += char('0' + empty);
+			empty = 0;
+			res += " PNBRQK  pnbrqk"[p];
+		}
+		if (empty)
+			res += char('0' + empty);
+		if (r > RANK_1)
+			res += '/';
+	}
+	res += stm == WHITE ? " w " : " b ";
+	string rights;
+	for (int cr = 0; cr < 4; cr++)
+		if (castling[cr])
+			rights += "KQkq"[cr];
+	res += (rights.empty() ? "-" : rights) + " " + ep + " 0 1";
+	return res;
+}
+
+
+static Piece pieceFromChar(char c)
+{
+	switch (c)
+	{
+	case 'P': return W_PAWN;
+	case 'N': return W_KNIGHT;
+	case 'B': return W_BISHOP;
+	case 'R': return W_ROOK;
+	case 'Q': return W_QUEEN;
+	case 'K': return W_KING;
+	case 'p': return B_PAWN;
+	case 'n': return B_KNIGHT;
+	case 'b': return B_BISHOP;
+	case 'r': return B_ROOK;
+	case 'q': return B_QUEEN;
+	case 'k': return B_KING;
+	default: return NO_PIECE;
+	}
+}
+
+
+bool parseFenBoard(const char* p, const char* end, PieceBoard& placed, Bitboard& occupied, bool& blackToMove)
+{
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	occupied = 0;
+	int rank = RANK_8, file = FILE_A, whiteKings = 0, blackKings = 0;
+	for (; p < end && *p != ' ' && *p != '\t'; p++)
+	{
+		if (*p >= '1' && *p <= '8')
+			file += *p - '0';
+		else if (*p == '/')
+		{
+			if (file != FILE_NB || rank == RANK_1)
+				return false;
+			rank--;
+			file = FILE_A;
+		}
+		else
+		{
+			const Piece pc = pieceFromChar(*p);
+			if (pc == NO_PIECE || file >= FILE_NB)
+				return false;
+			const Square sq = make_square(File(file++), Rank(rank));
+			placed[sq] = pc;
+			occupied |= square_bb(sq);
+			whiteKings += pc == W_KING;
+			blackKings += pc == B_KING;
+		}
+		if (file > FILE_NB)
+			return false;
+	}
+	if (rank != RANK_1 || file != FILE_NB || whiteKings != 1 || blackKings != 1 || popcount(occupied) > 32)
+		return false;
+
+	while (p < end && (*p == ' ' || *p == '\t'))
+		p++;
+	if (p < end && *p != 'w' && *p != 'b')
+		return false;
+	blackToMove = p < end && *p == 'b';
+	return true;
+}
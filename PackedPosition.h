@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include "position.h"
+
+
+//One PackedPosition code per square. Empty squares are only told apart by the occupancy
+using CodeBoard = std::array<uint8_t, SQUARE_NB>;
+using PieceBoard = std::array<Piece, SQUARE_NB>;
+
+
+//A position in 24 bytes: the occupied squares, then a 4-bit code for the piece on each of them in square order (low
+//nibble first). The codes are the SF Piece values, and the values SF doesn't use mark what a FEN adds to the board:
+//a rook that can still castle, a pawn that can be taken en passant, and the black king when black is to move.
+//Move counters aren't kept
+struct PackedPosition
+{
+	uint64_t occupied = 0;
+	std::array<uint8_t, 16> codes{};
+
+	static constexpr uint8_t CASTLING_ROOK = 0;		//Its color is the rank it stands on
+	static constexpr uint8_t EP_PAWN = 7;				//Just moved two squares. Its color is the rank it stands on
+	static constexpr uint8_t BLACK_KING_TO_MOVE = 8;
+
+	[[nodiscard]] static PackedPosition pack(const Position& pos);
+	[[nodiscard]] static PackedPosition fromCodes(uint64_t occupiedIn, const CodeBoard& board);
+	void toCodes(CodeBoard& board) const;
+	[[nodiscard]] std::string fen() const;
+
+	//The piece a code stands for on sq
+	[[nodiscard]] static inline Piece piece(uint8_t code, Square sq)
+	{
+		if (code == CASTLING_ROOK)
+			return rank_of(sq) <= RANK_4 ? W_ROOK : B_ROOK;
+		if (code == EP_PAWN)
+			return rank_of(sq) <= RANK_4 ? W_PAWN : B_PAWN;
+		if (code == BLACK_KING_TO_MOVE)
+			return B_KING;
+		return Piece(code);
+	}
+};
+
+static_assert(sizeof(PackedPosition) == 24, "packed positions are stored as raw 24-byte records");
+
+
+//Board and side to move of a FEN or EPD line, without allocations. A bare board is white to move. The other fields
+//are skipped. False unless the board has one king of each color and at most 32 pieces
+[[nodiscard]] bool parseFenBoard(const char* p, const char* end, PieceBoard& placed, Bitboard& occupied, bool& blackToMove);
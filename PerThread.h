@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+
+//One T per thread, each in an allocation of its own instead of next to its neighbors in a vector. place() reallocates a
+//thread's T from the calling thread, so that with --numa its pages are on that thread's node and no other thread's
+//data shares them
+template<typename T>
+class PerThread
+{
+private:
+	std::vector<std::unique_ptr<T>> items;
+
+public:
+	[[nodiscard]] T& operator[](size_t t)
+	{
+		return *items[t];
+	}
+
+	[[nodiscard]] const T& operator[](size_t t) const
+	{
+		return *items[t];
+	}
+
+	[[nodiscard]] size_t size() const
+	{
+		return items.size();
+	}
+
+	void clear()
+	{
+		items.clear();
+	}
+
+	template<typename... Args>
+	void emplace_back(Args&&... args)
+	{
+		items.push_back(std::make_unique<T>(std::forward<Args>(args)...));
+	}
+
+	void place(size_t t)
+	{
+		items[t] = std::make_unique<T>(*items[t]);
+	}
+};
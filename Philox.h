@@ -0,0 +1,26 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include "misc.h"
+
+
+//Philox4x64-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3"), a counter-based generator: the four
+//words of a counter only depend on the counter and the key, so any part of any stream can be generated directly
+[[nodiscard]] inline std::array<uint64_t, 4> philox4x64(std::array<uint64_t, 4> ctr, std::array<uint64_t, 2> key)
+{
+	constexpr uint64_t M0 = 0xD2E7470EE14C6C93ull, M1 = 0xCA5A826395121157ull;
+	constexpr uint64_t W0 = 0x9E3779B97F4A7C15ull, W1 = 0xBB67AE8584CAA73Bull;
+	for (int round = 0; round < 10; round++)
+	{
+		if (round > 0)
+		{
+			key[0] += W0;
+			key[1] += W1;
+		}
+		const uint64_t hi0 = mul_hi64(M0, ctr[0]), lo0 = M0 * ctr[0];
+		const uint64_t hi1 = mul_hi64(M1, ctr[2]), lo1 = M1 * ctr[2];
+		ctr = { hi1 ^ ctr[1] ^ key[0], lo1, hi0 ^ ctr[3] ^ key[1], lo0 };
+	}
+	return ctr;
+}
@@ -0,0 +1,421 @@
+#include "PositionFile.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+using std::vector;
+using std::cout;
+using std::endl;
+using std::string;
+
+static const int ZSTD_LEVEL = 3;
+
+
+PositionWriter::PositionWriter(const string& fname, EPositionFormat formatIn, bool compressIn, int nthreads)
+	: format(formatIn), compress(compressIn), queues(nthreads)
+{
+#ifndef USE_ZSTD
+	if (compress)
+	{
+		cout << "Built without zstd (USE_ZSTD), can't compress " << fname << endl;
+		return;
+	}
+#endif
+	file.open(fname, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		cout << "Could not open " << fname << endl;
+		return;
+	}
+	if (format == EPositionFormat::PACKED)
+	{
+		const PositionFileHeader header = { POSITION_FILE_MAGIC, compress ? PC_ZSTD : PC_NONE, uint32_t(sizeof(PackedPosition)) };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		bytesWritten += sizeof(header);
+	}
+
+	const size_t batchBytes = BATCH_POSITIONS * (format == EPositionFormat::PACKED ? sizeof(PackedPosition) : 100);
+	for (auto& q : queues)
+		for (auto& b : q.batches)
+			b.bytes.reserve(batchBytes);
+	writer = std::thread([this]() { writerLoop(); });
+}
+
+
+PositionWriter::~PositionWriter()
+{
+	close();
+}
+
+
+bool PositionWriter::isOpen() const
+{
+	return writer.joinable();
+}
+
+
+void PositionWriter::add(int tnum, const Position& pos)
+{
+	Queue& q = queues[tnum];
+	Batch& b = q.batches[q.filled.load(std::memory_order_relaxed) % QUEUE_BATCHES];
+	if (format == EPositionFormat::PACKED)
+	{
+		const PackedPosition pp = PackedPosition::pack(pos);
+		const char* p = reinterpret_cast<const char*>(&pp);
+		b.bytes.insert(b.bytes.end(), p, p + sizeof(pp));
+	}
+	else
+	{
+		const string fen = pos.fen();
+		b.bytes.insert(b.bytes.end(), fen.begin(), fen.end());
+		b.bytes.push_back('\n');
+	}
+	if (++b.positions == BATCH_POSITIONS)
+		handOver(tnum);
+}
+
+
+void PositionWriter::handOver(int tnum)
+{
+	Queue& q = queues[tnum];
+	const uint64_t filled = q.filled.load(std::memory_order_relaxed) + 1;
+	q.filled.store(filled, std::memory_order_release);
+
+	//The next batch is free once the writer is less than a whole ring behind
+	while (filled - q.written.load(std::memory_order_acquire) >= QUEUE_BATCHES)
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	Batch& next = q.batches[filled % QUEUE_BATCHES];
+	next.bytes.clear();
+	next.positions = 0;
+}
+
+
+void PositionWriter::writeBatch(const Batch& b)
+{
+	const char* data = b.bytes.data();
+	size_t size = b.bytes.size();
+#ifdef USE_ZSTD
+	if (compress)
+	{
+		compressed.resize(ZSTD_compressBound(size));
+		const size_t res = ZSTD_compress(compressed.data(), compressed.size(), data, size, ZSTD_LEVEL);
+		if (ZSTD_isError(res))
+		{
+			cout << "zstd: " << ZSTD_getErrorName(res) << endl;
+			file.setstate(std::ios::failbit);
+			return;
+		}
+		data = compressed.data();
+		size = res;
+	}
+#endif
+	if (format == EPositionFormat::PACKED)
+	{
+		const PositionBlockHeader header = { b.positions, uint32_t(size) };
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		bytesWritten += sizeof(header);
+	}
+	file.write(data, size);
+	bytesWritten += size;
+	positionsWritten += b.positions;
+}
+
+
+void PositionWriter::writerLoop()
+{
+	for (;;)
+	{
+		//Read before looking at the rings: once closing is set, no more batches come
+		const bool finishing = closing.load(std::memory_order_acquire);
+		bool any = false;
+		for (auto& q : queues)
+		{
+			uint64_t written = q.written.load(std::memory_order_relaxed);
+			for (; written < q.filled.load(std::memory_order_acquire); any = true)
+			{
+				writeBatch(q.batches[written % QUEUE_BATCHES]);
+				q.written.store(++written, std::memory_order_release);
+			}
+		}
+		if (!any && finishing)
+			return;
+		if (!any)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+
+void PositionWriter::close()
+{
+	if (!writer.joinable())
+		return;
+	for (int t = 0; t < int(queues.size()); t++)
+	{
+		const Queue& q = queues[t];
+		if (q.batches[q.filled.load(std::memory_order_relaxed) % QUEUE_BATCHES].positions > 0)
+			handOver(t);
+	}
+	closing.store(true, std::memory_order_release);
+	writer.join();
+	file.close();
+	if (!file)
+		cout << "Error writing positions" << endl;
+}
+
+
+int64_t PositionWriter::getPositionsWritten() const
+{
+	return positionsWritten;
+}
+
+
+int64_t PositionWriter::getBytesWritten() const
+{
+	return bytesWritten;
+}
+
+
+MappedFile::~MappedFile()
+{
+	close();
+}
+
+
+bool MappedFile::open(const string& fname)
+{
+	close();
+#ifdef _WIN32
+	fileHandle = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	LARGE_INTEGER fileSize;
+	if (fileHandle == INVALID_HANDLE_VALUE || !GetFileSizeEx(fileHandle, &fileSize))
+	{
+		fileHandle = nullptr;
+		cout << "Could not open " << fname << endl;
+		return false;
+	}
+	size = size_t(fileSize.QuadPart);
+	mapHandle = size ? CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	data = mapHandle ? static_cast<const char*>(MapViewOfFile(mapHandle, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+#else
+	const int fd = ::open(fname.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd < 0 || fstat(fd, &st) != 0)
+	{
+		if (fd >= 0)
+			::close(fd);
+		cout << "Could not open " << fname << endl;
+		return false;
+	}
+	size = size_t(st.st_size);
+	void* p = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	::close(fd);
+	if (p != MAP_FAILED)
+	{
+		data = static_cast<const char*>(p);
+		madvise(p, size, MADV_SEQUENTIAL);
+	}
+#endif
+	if (size && !data)
+	{
+		cout << "Could not map " << fname << endl;
+		close();
+		return false;
+	}
+	return true;
+}
+
+
+void MappedFile::close()
+{
+#ifdef _WIN32
+	if (data)
+		UnmapViewOfFile(data);
+	if (mapHandle)
+		CloseHandle(mapHandle);
+	if (fileHandle)
+		CloseHandle(fileHandle);
+	mapHandle = fileHandle = nullptr;
+#else
+	if (data)
+		munmap(const_cast<char*>(data), size);
+#endif
+	data = nullptr;
+	size = 0;
+}
+
+
+const char* MappedFile::begin() const
+{
+	return data;
+}
+
+
+size_t MappedFile::getSize() const
+{
+	return size;
+}
+
+
+//Does the file start like a PACKED position file?
+bool MappedFile::isPositionFile() const
+{
+	return size >= POSITION_FILE_MAGIC.size() && std::memcmp(data, POSITION_FILE_MAGIC.data(), POSITION_FILE_MAGIC.size()) == 0;
+}
+
+
+bool MappedPositionFile::open(const string& fname)
+{
+	close();
+	if (!file.open(fname))
+		return false;
+	const char* data = file.begin();
+	const size_t size = file.getSize();
+
+	PositionFileHeader header;
+	if (size < sizeof(header))
+	{
+		cout << "Not a packed position file: " << fname << endl;
+		close();
+		return false;
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (header.magic != POSITION_FILE_MAGIC || header.recordBytes != sizeof(PackedPosition) || header.compression > PC_ZSTD)
+	{
+		cout << "Not a packed position file: " << fname << endl;
+		close();
+		return false;
+	}
+#ifndef USE_ZSTD
+	if (header.compression == PC_ZSTD)
+	{
+		cout << "Built without zstd (USE_ZSTD), can't read " << fname << endl;
+		close();
+		return false;
+	}
+#endif
+	compression = header.compression;
+
+	for (size_t offset = sizeof(header); offset < size; )
+	{
+		PositionBlockHeader bh;
+		if (size - offset < sizeof(bh))
+		{
+			cout << "Truncated position file: " << fname << endl;
+			close();
+			return false;
+		}
+		std::memcpy(&bh, data + offset, sizeof(bh));
+		offset += sizeof(bh);
+		if (bh.storedBytes > size - offset || (compression == PC_NONE && bh.storedBytes != size_t(bh.positions) * sizeof(PackedPosition)))
+		{
+			cout << "Truncated position file: " << fname << endl;
+			close();
+			return false;
+		}
+		blocks.push_back({ data + offset, bh.positions, bh.storedBytes, positions });
+		positions += bh.positions;
+		offset += bh.storedBytes;
+	}
+	return true;
+}
+
+
+void MappedPositionFile::close()
+{
+	file.close();
+	blocks.clear();
+	positions = 0;
+}
+
+
+const vector<PositionBlock>& MappedPositionFile::getBlocks() const
+{
+	return blocks;
+}
+
+
+int64_t MappedPositionFile::getPositions() const
+{
+	return positions;
+}
+
+
+const PackedPosition* MappedPositionFile::blockPositions(const PositionBlock& block, vector<PackedPosition>& scratch) const
+{
+	//Block data is 8-byte aligned: the file header is 16 bytes, block headers 8 and positions 24
+	if (compression == PC_NONE)
+		return reinterpret_cast<const PackedPosition*>(block.data);
+#ifdef USE_ZSTD
+	scratch.resize(block.positions);
+	const size_t rawBytes = size_t(block.positions) * sizeof(PackedPosition);
+	if (ZSTD_decompress(scratch.data(), rawBytes, block.data, block.storedBytes) == rawBytes)
+		return scratch.data();
+#endif
+	return nullptr;
+}
+
+
+bool readPositionFile(const string& fname, const std::function<void(const PackedPosition* positions, size_t n)>& f)
+{
+	MappedPositionFile file;
+	if (!file.open(fname))
+		return false;
+
+	vector<PackedPosition> scratch;
+	for (const auto& block : file.getBlocks())
+	{
+		const PackedPosition* positions = file.blockPositions(block, scratch);
+		if (!positions)
+		{
+			cout << "Corrupt position file: " << fname << endl;
+			return false;
+		}
+		f(positions, block.positions);
+	}
+	return true;
+}
+
+
+bool readFens(const string& fname, vector<string>& fens)
+{
+	fens.clear();
+	MappedFile file;
+	if (!file.open(fname))
+		return false;
+	if (file.isPositionFile())
+	{
+		file.close();
+		return readPositionFile(fname, [&](const PackedPosition* positions, size_t n)
+		{
+			for (size_t q = 0; q < n; q++)
+				fens.push_back(positions[q].fen());
+		});
+	}
+
+	const char* p = file.begin();
+	const char* end = p + file.getSize();
+	while (p < end)
+	{
+		const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+		const char* lineEnd = nl ? nl : end;
+		const char* trimmed = lineEnd;
+		while (trimmed > p && (trimmed[-1] == '\r' || trimmed[-1] == ' ' || trimmed[-1] == '\t'))
+			trimmed--;
+		if (trimmed > p)
+			fens.emplace_back(p, trimmed);
+		p = lineEnd + 1;
+	}
+	return true;
+}
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PackedPosition.h"
+
+enum class EPositionFormat {
+	FEN,				//One FEN per line. With zstd, every batch is a zstd frame, so the file is a valid .zst
+	PACKED			//PositionFileHeader, then blocks of 24-byte PackedPositions, each after a PositionBlockHeader
+};
+
+
+struct PositionFileHeader
+{
+	std::array<char, 8> magic;
+	uint32_t compression;					//EPositionCompression
+	uint32_t recordBytes;					//sizeof(PackedPosition)
+};
+
+struct PositionBlockHeader
+{
+	uint32_t positions;						//Positions in the block
+	uint32_t storedBytes;					//Bytes that follow. positions * recordBytes unless compressed
+};
+
+enum EPositionCompression : uint32_t { PC_NONE, PC_ZSTD };
+
+constexpr std::array<char, 8> POSITION_FILE_MAGIC = { 'C', 'C', 'P', 'O', 'S', '0', '0', '1' };
+
+
+//Streams positions from many threads to one file. Every thread fills its own batches and hands them over through its
+//own ring, without locks, and a writer thread appends (and compresses) them in the order they arrive. A thread only
+//waits if the writer is a whole ring behind
+class PositionWriter
+{
+private:
+	static constexpr int QUEUE_BATCHES = 8;				//Batches per thread ring
+	static constexpr uint32_t BATCH_POSITIONS = 16384;	//Positions per batch
+
+	struct Batch
+	{
+		std::vector<char> bytes;
+		uint32_t positions = 0;
+	};
+
+	struct alignas(64) Queue
+	{
+		std::array<Batch, QUEUE_BATCHES> batches;
+		std::atomic<uint64_t> filled = 0;					//Batches the thread has handed over
+		alignas(64) std::atomic<uint64_t> written = 0;	//Batches the writer is done with
+	};
+
+	EPositionFormat format;
+	bool compress = false;
+	std::ofstream file;
+	std::vector<Queue> queues;
+	std::vector<char> compressed;							//Writer thread's compression buffer
+	std::atomic<bool> closing = false;
+	std::thread writer;
+	int64_t positionsWritten = 0;
+	int64_t bytesWritten = 0;
+
+	void handOver(int tnum);
+	void writeBatch(const Batch& b);
+	void writerLoop();
+
+public:
+	PositionWriter(const std::string& fname, EPositionFormat formatIn, bool compressIn, int nthreads);
+	~PositionWriter();
+	[[nodiscard]] bool isOpen() const;
+
+	//Called by worker tnum only
+	void add(int tnum, const Position& pos);
+
+	//After the workers stopped. Writes what is left and closes the file
+	void close();
+	[[nodiscard]] int64_t getPositionsWritten() const;
+	[[nodiscard]] int64_t getBytesWritten() const;
+};
+
+
+//A whole file mapped read-only into memory. Empty files map to nullptr and size 0
+class MappedFile
+{
+private:
+	const char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mapHandle = nullptr;
+#endif
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	[[nodiscard]] bool open(const std::string& fname);
+	void close();
+	[[nodiscard]] const char* begin() const;
+	[[nodiscard]] size_t getSize() const;
+	[[nodiscard]] bool isPositionFile() const;
+};
+
+
+struct PositionBlock
+{
+	const char* data = nullptr;				//Stored bytes, in the mapping
+	uint32_t positions = 0;
+	uint32_t storedBytes = 0;
+	int64_t first = 0;							//Positions in the blocks before this one
+};
+
+
+//A PACKED file mapped into memory, with an index of its blocks. The positions of uncompressed blocks are read in place,
+//straight from the page cache, so a whole dataset goes through the checks at memory bandwidth. Blocks are independent
+//and can be read from any number of threads
+class MappedPositionFile
+{
+private:
+	MappedFile file;
+	uint32_t compression = PC_NONE;
+	std::vector<PositionBlock> blocks;
+	int64_t positions = 0;
+
+public:
+	[[nodiscard]] bool open(const std::string& fname);
+	void close();
+	[[nodiscard]] const std::vector<PositionBlock>& getBlocks() const;
+	[[nodiscard]] int64_t getPositions() const;
+
+	//The positions of a block. In the mapping if it isn't compressed, otherwise decompressed into scratch.
+	//nullptr if it can't be decompressed
+	[[nodiscard]] const PackedPosition* blockPositions(const PositionBlock& block, std::vector<PackedPosition>& scratch) const;
+};
+
+
+//Calls f on every block of a PACKED file, in order. False if the file can't be read
+[[nodiscard]] bool readPositionFile(const std::string& fname, const std::function<void(const PackedPosition* positions, size_t n)>& f);
+
+//The positions of a packed file or a FEN/EPD file (one per line, blank lines skipped) as FENs
+[[nodiscard]] bool readFens(const std::string& fname, std::vector<std::string>& fens);
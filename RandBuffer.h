@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include "misc.h"
+#include "Philox.h"
+
+
+//Per-thread block of random 64-bit words. The generator refills the whole block at once
+//(vectorized for generators that provide fill()), draws are then just loads.
+//After startSample, the words come from Philox on the sample's index instead, SAMPLE_WORDS at a time at the end of the
+//block, so they don't depend on the thread or on the samples before
+template<typename TGen>
+struct alignas(64) RandBuffer
+{
+	static constexpr int SIZE = 512;
+	static constexpr int SAMPLE_WORDS = 64;
+	std::array<uint64_t, SIZE> words;
+	int pos = SIZE;
+	TGen gen;
+	bool perSample = false;							//Counter-based mode, set by startSample
+	std::array<uint64_t, 2> sampleKey{};
+	uint64_t sampleIndex = 0;
+	uint64_t sampleCounter = 0;					//Philox blocks of this sample used so far
+
+	RandBuffer() = default;
+	explicit RandBuffer(const TGen& genIn) : gen(genIn) {}
+
+	//The next draws are the stream of sample index under key
+	void startSample(const std::array<uint64_t, 2>& key, uint64_t index)
+	{
+		perSample = true;
+		sampleKey = key;
+		sampleIndex = index;
+		sampleCounter = 0;
+		refill();
+	}
+
+	void refill()
+	{
+		if (perSample)
+		{
+			pos = SIZE - SAMPLE_WORDS;
+			for (int q = pos; q < SIZE; q += 4)
+			{
+				const auto r = philox4x64({ sampleIndex, sampleCounter++, 0, 0 }, sampleKey);
+				std::copy(r.begin(), r.end(), words.begin() + q);
+			}
+			return;
+		}
+		if constexpr (requires(TGen g, uint64_t* p) { g.fill(p, size_t(SIZE)); })
+			gen.fill(words.data(), SIZE);
+		else
+			for (auto& w : words)
+				w = uint64_t(gen());
+		pos = 0;
+	}
+
+	//Make sure the next n draws come from the same block
+	inline void reserve(int n)
+	{
+		if (pos + n > SIZE)
+			refill();
+	}
+
+	[[nodiscard]] inline uint64_t next()
+	{
+		if (pos == SIZE)
+			refill();
+		return words[pos++];
+	}
+
+	//Uniform in [0, range). Lemire's nearly divisionless method: the division only happens in the rare rejection case
+	[[nodiscard]] inline uint64_t bounded(uint64_t range)
+	{
+		uint64_t x = next();
+		uint64_t low = x * range;
+		if (low < range)
+		{
+			const uint64_t threshold = (0 - range) % range;
+			while (low < threshold)
+			{
+				x = next();
+				low = x * range;
+			}
+		}
+		return mul_hi64(x, range);
+	}
+
+	//Uniform in [0, 1)
+	[[nodiscard]] inline double real()
+	{
+		return (next() >> 11) * (1.0 / 9007199254740992.0);
+	}
+};
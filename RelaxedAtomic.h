@@ -0,0 +1,38 @@
+#pragma once
+
+#include <atomic>
+
+
+//Value written by one thread and read by any other. Relaxed loads and stores compile to plain moves on x86,
+//so the owner updates it at full speed and readers never stop it
+template<typename T>
+class RelaxedAtomic
+{
+private:
+	std::atomic<T> value;
+
+public:
+	RelaxedAtomic(T v = T()) : value(v) {}
+	RelaxedAtomic(const RelaxedAtomic& other) : value(other.get()) {}
+	RelaxedAtomic& operator=(const RelaxedAtomic& other)
+	{
+		set(other.get());
+		return *this;
+	}
+
+	[[nodiscard]] inline T get() const
+	{
+		return value.load(std::memory_order_relaxed);
+	}
+
+	inline void set(T v)
+	{
+		value.store(v, std::memory_order_relaxed);
+	}
+
+	//Only for the owning thread: not an atomic read-modify-write
+	inline void add(T d)
+	{
+		set(get() + d);
+	}
+};
@@ -0,0 +1,116 @@
+#include "RestrictionProfile.h"
+#include <cctype>
+#include <iostream>
+
+using std::cout;
+using std::endl;
+using std::string;
+
+static const std::array<int, PK_NB> MOST_WITH_UNDERPROMOTIONS = { 8, 10, 10, 10, 9 };	//Each pawn can become one more of a piece
+static const std::array<int, PK_NB> MOST_WITHOUT_UNDERPROMOTIONS = { 8, 2, 2, 2, 9 };
+
+
+RestrictionProfile::RestrictionProfile(const PieceCaps& capsIn, bool underpromotionsIn) : caps(capsIn), underpromotions(underpromotionsIn)
+{
+	maxcount.fill(0);
+	const std::array<PieceType, PK_NB> types = { PAWN, KNIGHT, BISHOP, ROOK, QUEEN };
+	for (int k = 0; k < PK_NB; k++)
+	{
+		maxcount[make_piece(WHITE, types[k])] = caps.maxCount[k];
+		maxcount[make_piece(BLACK, types[k])] = caps.maxCount[k];
+	}
+	maxcount[W_KING] = maxcount[B_KING] = 1;
+}
+
+
+//RESTRICTED, VERY_RESTRICTED, or caps like P8N2B2R2Q2T3U: a letter and the most pieces of that kind per side, T for
+//the most queens in total and U to allow underpromotions. Kinds that aren't given keep the RESTRICTED caps, so Q2 is
+//RESTRICTED with at most 2 queens per side
+bool RestrictionProfile::parse(const string& spec, RestrictionProfile& rp)
+{
+	if (spec == "RESTRICTED")
+	{
+		rp = PROFILE_RESTRICTED;
+		return true;
+	}
+	if (spec == "VERY_RESTRICTED")
+	{
+		rp = PROFILE_VERY_RESTRICTED;
+		return true;
+	}
+
+	std::array<int, PK_NB> maxCount = PROFILE_RESTRICTED.caps.maxCount;
+	int queensTotal = -1;
+	bool allowUnderpromotions = false;
+	const string kinds = "PNBRQ";
+	for (size_t q = 0; q < spec.size(); )
+	{
+		const char c = char(std::toupper(spec[q++]));
+		if (c == 'U')
+		{
+			allowUnderpromotions = true;
+			continue;
+		}
+		size_t end = q;
+		while (end < spec.size() && std::isdigit((unsigned char)spec[end]))
+			end++;
+		const size_t kind = kinds.find(c);
+		if (end == q || end - q > 2 || (kind == string::npos && c != 'T'))
+		{
+			cout << "Bad restriction profile " << spec << ": expected RESTRICTED, VERY_RESTRICTED or caps like P8N2B2R2Q2T3U" << endl;
+			return false;
+		}
+		const int n = std::stoi(spec.substr(q, end - q));
+		if (c == 'T')
+			queensTotal = n;
+		else
+			maxCount[kind] = n;
+		q = end;
+	}
+
+	const auto& most = allowUnderpromotions ? MOST_WITH_UNDERPROMOTIONS : MOST_WITHOUT_UNDERPROMOTIONS;
+	for (int k = 0; k < PK_NB; k++)
+	{
+		if (maxCount[k] > most[k])
+		{
+			cout << "Bad restriction profile " << spec << ": at most " << most[k] << " " << kinds[k] << " per side"
+				<< (allowUnderpromotions ? "" : " without underpromotions (U)") << endl;
+			return false;
+		}
+	}
+	if (queensTotal > 2 * maxCount[PK_QUEEN])
+		queensTotal = -1;			//Already implied by the queens per side
+	
+	int64_t size = 1;
+	for (int c : maxCount)
+		size *= (c + 1) * (c + 1);
+	if (size > PieceCaps::MAX_SIZE)
+	{
+		cout << "Bad restriction profile " << spec << ": " << size << " piece-count combinations, at most " << PieceCaps::MAX_SIZE << endl;
+		return false;
+	}
+
+	rp = RestrictionProfile(PieceCaps(maxCount, queensTotal), allowUnderpromotions);
+	return true;
+}
+
+
+//As parse() reads it, for example P8N2B2R2Q3
+string RestrictionProfile::name() const
+{
+	return caps.name() + (underpromotions ? "U" : "");
+}
+
+
+//For example "without underpromotions and with at most 3 queens per side"
+string RestrictionProfile::describe() const
+{
+	string res = underpromotions ? "with underpromotions and" : "without underpromotions and with";
+	res += " at most " + std::to_string(caps.maxCount[PK_QUEEN]) + (caps.maxCount[PK_QUEEN] == 1 ? " queen" : " queens") + " per side";
+	if (caps.maxQueensTotal >= 0)
+		res += " and " + std::to_string(caps.maxQueensTotal) + " in total";
+	if (caps.maxCount[PK_PAWN] < 8 || caps.maxCount[PK_KNIGHT] < 2 || caps.maxCount[PK_BISHOP] < 2 || caps.maxCount[PK_ROOK] < 2
+		|| (underpromotions && (caps.maxCount[PK_KNIGHT] != 2 || caps.maxCount[PK_BISHOP] != 2 || caps.maxCount[PK_ROOK] != 2)))
+		res += " (" + name() + ")";
+	return res;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <array>
+#include <string>
+#include "types.h"
+#include "CombTables.h"
+
+
+//What a restricted estimate counts: at most so many pieces of each kind per side, at most so many queens in total, and
+//no underpromotions unless they are allowed. The same profile gives the combination table RESTRICTED draws from, the
+//decoding of its indices and LegalChecker::checkAdditionalConditions
+struct RestrictionProfile
+{
+	PieceCaps caps;									//Most pieces of each kind per side and most queens in total
+	bool underpromotions = false;				//Positions that need an underpromotion count too
+	std::array<int, PIECE_NB> maxcount{};		//caps by Piece, for checking LegalChecker counts
+
+	RestrictionProfile(const PieceCaps& capsIn = PieceCaps(), bool underpromotionsIn = false);
+	[[nodiscard]] static bool parse(const std::string& spec, RestrictionProfile& rp);
+	[[nodiscard]] std::string name() const;
+	[[nodiscard]] std::string describe() const;
+};
+
+
+inline const RestrictionProfile PROFILE_RESTRICTED(PieceCaps({ 8, 2, 2, 2, 3 }));
+inline const RestrictionProfile PROFILE_VERY_RESTRICTED(PieceCaps({ 8, 2, 2, 2, 1 }));
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include "RelaxedAtomic.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+//Rules of LegalChecker::checkConditions. Any order gives the same result
+enum ERule {
+	RULE_BY_SIDE,					//Piece counts of each side
+	RULE_PAWN_RANKS,				//No pawns on RANK_1/RANK_8
+	RULE_COUNTS,					//Promotions needed vs missing pieces
+	RULE_BLACK_IN_CHECK,			//Side not to move can't be in check
+	RULE_BISHOPS,					//Bishops trapped behind unmoved pawns
+	RULE_PAWN_STRUCTURES,		//Impossible pawn structures
+	RULE_SAME_FILE,				//Doubled pawns need captures
+	RULE_ATTACKS,					//Checks of the white king must be explainable by the last move
+	RULE_NB
+};
+
+constexpr std::array<const char*, RULE_NB> RULE_NAMES =
+	{ "by side", "pawn ranks", "counts", "black in check", "bishops", "pawn structures", "same file", "attacks" };
+
+//Rules that look at the board. It is set up (LeanBoard or SF positions) right before the first of them runs
+constexpr std::array<bool, RULE_NB> RULE_NEEDS_BOARD = { false, false, false, true, true, true, true, true };
+
+
+[[nodiscard]] inline uint64_t cycleCount()
+{
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return uint64_t(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+}
+
+
+//Per-thread rejection counts and cost of each rule, plus the order this thread runs them in.
+//Only the owning thread writes, the reporter thread reads
+struct alignas(64) RuleStats
+{
+	static constexpr int64_t TIME_EVERY = 16;		//Only every 16th sample is timed, reading the TSC costs as much as a cheap rule
+
+	std::array<RelaxedAtomic<int64_t>, RULE_NB> checked;		//Samples that reached the rule
+	std::array<RelaxedAtomic<int64_t>, RULE_NB> rejected;		//Samples the rule rejected
+	std::array<RelaxedAtomic<int64_t>, RULE_NB> timed;			//Timed runs of the rule
+	std::array<RelaxedAtomic<uint64_t>, RULE_NB> cycles;		//Cycles spent in the timed runs
+	RelaxedAtomic<int64_t> boardTimed;								//Timed board setups
+	RelaxedAtomic<uint64_t> boardCycles;							//Cycles spent in the timed board setups
+	RelaxedAtomic<int64_t> samples;									//Samples checked by this thread
+	std::array<RelaxedAtomic<ERule>, RULE_NB> order = { RULE_BY_SIDE, RULE_PAWN_RANKS, RULE_COUNTS, RULE_BLACK_IN_CHECK,
+		RULE_BISHOPS, RULE_PAWN_STRUCTURES, RULE_SAME_FILE, RULE_ATTACKS };
+
+	[[nodiscard]] double rejectRate(ERule rule) const
+	{
+		return (rejected[rule].get() + 1.0) / (checked[rule].get() + 2.0);
+	}
+
+	[[nodiscard]] double cyclesPerCheck(ERule rule) const
+	{
+		return timed[rule].get() ? double(cycles[rule].get()) / timed[rule].get() : 0;
+	}
+
+	//Most rejections per cycle first. Rates are conditional on the rules that ran before, so this is redone periodically
+	void reorder()
+	{
+		std::array<ERule, RULE_NB> sorted;
+		for (int r = 0; r < RULE_NB; r++)
+			sorted[r] = order[r].get();
+		std::stable_sort(sorted.begin(), sorted.end(), [this](ERule a, ERule b)
+		{
+			return rejectRate(a) / (cyclesPerCheck(a) + 1) > rejectRate(b) / (cyclesPerCheck(b) + 1);
+		});
+		for (int r = 0; r < RULE_NB; r++)
+			order[r].set(sorted[r]);
+	}
+
+	//Calls f on every counter (not the order), always in the same order. For checkpoints
+	template<typename TStats, typename F>
+	static void forEachCounter(TStats& rs, F&& f)
+	{
+		for (int r = 0; r < RULE_NB; r++)
+		{
+			f(rs.checked[r]);
+			f(rs.rejected[r]);
+			f(rs.timed[r]);
+			f(rs.cycles[r]);
+		}
+		f(rs.boardTimed);
+		f(rs.boardCycles);
+		f(rs.samples);
+	}
+
+	//Only for totals owned by the caller
+	RuleStats& operator+=(const RuleStats& other)
+	{
+		for (int r = 0; r < RULE_NB; r++)
+		{
+			checked[r].add(other.checked[r].get());
+			rejected[r].add(other.rejected[r].get());
+			timed[r].add(other.timed[r].get());
+			cycles[r].add(other.cycles[r].get());
+		}
+		boardTimed.add(other.boardTimed.get());
+		boardCycles.add(other.boardCycles.get());
+		samples.add(other.samples.get());
+		return *this;
+	}
+};
@@ -0,0 +1,106 @@
+#include "Strata.h"
+#include "LegalParams.h"
+#include <cmath>
+
+using std::vector;
+
+
+void Strata::build(const vector<OneComb>& combs, const std::function<int(int)>& piecesOf)
+{
+	std::array<vector<OneComb>, NUM_STRATA> byStratum;
+	double total = 0;
+	for (const auto& c : combs)
+	{
+		if (c.val <= 0)
+			continue;
+		byStratum[piecesOf(c.idx)].push_back(c);
+		total += c.val;
+	}
+
+	for (int h = 0; h < NUM_STRATA; h++)
+	{
+		weights[h] = 0;
+		if (byStratum[h].empty())
+			continue;
+		tables[h].build(byStratum[h]);
+		weights[h] = tables[h].getSum() / total;
+	}
+}
+
+
+double Strata::weight(int stratum) const
+{
+	return weights[stratum];
+}
+
+
+//Neyman allocation with costs: stratum h gets samples in proportion to W_h * s_h / sqrt(c_h), where s_h is the standard
+//deviation of its per-sample values and c_h its time per sample. Until there are enough nonzero samples for the standard
+//deviations, in proportion to W_h. A fixed part stays proportional, so that a stratum whose hits haven't shown up yet
+//is still sampled
+std::array<double, NUM_STRATA> Strata::allocation(const StrataTotals& t, double hits) const
+{
+	std::array<double, NUM_STRATA> alloc = weights;
+	if (hits >= PILOT_HITS)
+	{
+		double allSamples = 0, allCycles = 0;
+		for (int h = 0; h < NUM_STRATA; h++)
+		{
+			allSamples += t.samples[h];
+			allCycles += t.cycles[h];
+		}
+		const double meanCost = allSamples > 0 ? std::max(allCycles / allSamples, 1.0) : 1.0;
+
+		std::array<double, NUM_STRATA> neyman{};
+		double neymanSum = 0;
+		for (int h = 0; h < NUM_STRATA; h++)
+		{
+			if (weights[h] == 0 || t.samples[h] < 2)
+				continue;
+			const double n = t.samples[h];
+			const double var = std::max(0.0, (t.sumSq[h] - t.sum[h] * t.sum[h] / n) / (n - 1));
+			const double cost = t.cycles[h] > 0 ? t.cycles[h] / n : meanCost;
+			neyman[h] = weights[h] * std::sqrt(var / cost);
+			neymanSum += neyman[h];
+		}
+		if (neymanSum > 0)
+			for (int h = 0; h < NUM_STRATA; h++)
+				alloc[h] = (1 - PROPORTIONAL_SHARE) * neyman[h] / neymanSum + PROPORTIONAL_SHARE * weights[h];
+	}
+
+	double sum = 0;
+	for (int h = 0; h < NUM_STRATA; h++)
+	{
+		if (weights[h] > 0)
+			alloc[h] = std::max(alloc[h], MIN_SHARE);
+		sum += alloc[h];
+	}
+	for (auto& a : alloc)
+		a /= sum;
+	return alloc;
+}
+
+
+//W_h times the mean of stratum h, and its standard error. Relative to the size of the search space
+std::pair<double, double> Strata::stratumEstimate(const StrataTotals& t, int stratum) const
+{
+	const double n = t.samples[stratum];
+	if (weights[stratum] == 0 || n == 0)
+		return { 0, 0 };
+	const double var = n > 1 ? std::max(0.0, (t.sumSq[stratum] - t.sum[stratum] * t.sum[stratum] / n) / (n - 1)) : 0;
+	return { weights[stratum] * t.sum[stratum] / n, weights[stratum] * std::sqrt(var / n) };
+}
+
+
+//Sum of the stratum estimates and its standard error
+std::pair<double, double> Strata::estimate(const StrataTotals& t) const
+{
+	double est = 0, var = 0;
+	for (int h = 0; h < NUM_STRATA; h++)
+	{
+		const auto [e, se] = stratumEstimate(t, h);
+		est += e;
+		var += se * se;
+	}
+	return { est, std::sqrt(var) };
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <utility>
+#include <vector>
+#include "AliasTable.h"
+
+struct OneComb;
+
+constexpr int NUM_STRATA = 31;			//Strata are the numbers of non-king pieces, 0-30
+
+
+//Running totals of a stratified estimate, per stratum
+struct StrataTotals
+{
+	std::array<double, NUM_STRATA> samples{};	//Samples drawn from the stratum
+	std::array<double, NUM_STRATA> sum{};		//Sum of the per-sample values
+	std::array<double, NUM_STRATA> sumSq{};		//Sum of the squared per-sample values
+	std::array<double, NUM_STRATA> cycles{};	//Time spent on the stratum's samples
+};
+
+
+//Piece-count combinations of one sample type grouped by their number of non-king pieces. Each stratum has its own
+//sampler and its exact share of the search space, so a stratified estimate can draw the strata in any proportions
+class Strata
+{
+private:
+	std::array<AliasTable, NUM_STRATA> tables;				//Combinations of each stratum, in proportion to their size
+	std::array<double, NUM_STRATA> weights{};				//Share of the search space of each stratum. Sum to 1
+
+public:
+	static constexpr double PROPORTIONAL_SHARE = 0.1;		//Part of the samples always allocated in proportion to the weights
+	static constexpr double MIN_SHARE = 1e-5;				//Every stratum gets at least this part of the samples
+	static constexpr double PILOT_HITS = 200;				//Nonzero samples before Neyman allocation replaces proportional allocation
+
+	void build(const std::vector<OneComb>& combs, const std::function<int(int)>& piecesOf);
+	[[nodiscard]] double weight(int stratum) const;
+	[[nodiscard]] int pick(int stratum, uint64_t r) const
+	{
+		return tables[stratum].pick(r);
+	}
+	[[nodiscard]] std::array<double, NUM_STRATA> allocation(const StrataTotals& t, double hits) const;
+	[[nodiscard]] std::pair<double, double> stratumEstimate(const StrataTotals& t, int stratum) const;
+	[[nodiscard]] std::pair<double, double> estimate(const StrataTotals& t) const;
+};
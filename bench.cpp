@@ -0,0 +1,738 @@
+#include "runner.h"
+#include "AllocCounter.h"
+#include "EstimateStats.h"
+#include "LegalParams.h"
+#include "LegalChecker.h"
+#include "MateSolver.h"
+#include "Options.h"
+#include "PackedPosition.h"
+#include "PositionFile.h"
+#include <omp.h>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <memory>
+
+using std::vector;
+using std::cout;
+using std::endl;
+using std::string;
+
+static const string BENCH_HEADER = "ChessCounter bench-counter 1";
+
+
+//Alias table vs binary search over partial sums for the piece-count combinations
+void Runner::benchSampler(int argc, char* argv[])
+{
+	LegalParams lp;
+	if (!lp.setup(argc, argv, 1))
+		return;
+
+	const int64_t DRAWS = 20'000'000;
+	int64_t sink = 0;
+
+	auto timeIt = [&](auto&& draw)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for (int64_t x = 0; x < DRAWS; x++)
+			sink += draw();
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		return elapsed.count() / DRAWS;
+	};
+
+	struct OneTable
+	{
+		string name;
+		const vector<OneComb>& combs;
+		const vector<double>& partialSums;
+		double sum;
+		const AliasTable& alias;
+	};
+
+	const vector<OneTable> tables =
+	{
+		{"PIECES", lp.combs, lp.combsPartialSum, lp.combsSum, lp.aliasCombs},
+		{"PIECES_WB", lp.combsWB, lp.combsWBPartialSum, lp.combsSumWB, lp.aliasCombsWB},
+		{lp.profile.name(), lp.combsRestricted, lp.combsRestrictedPartialSum, lp.combsSumRestricted, lp.aliasRestricted}
+	};
+
+	cout << endl << "Sampler benchmark, " << DRAWS << " draws per table" << endl;
+	for (const auto& t : tables)
+	{
+		double nsSearch = timeIt([&]() { return lp.pickRandomKnownSum(t.combs, t.sum, t.partialSums); });
+		double nsAlias = timeIt([&]() { return lp.pickAlias(t.alias); });
+		cout << std::setw(16) << t.name << "  entries: " << std::setw(7) << t.combs.size()
+			<< "  binary search: " << std::setw(7) << nsSearch << " ns"
+			<< "  alias: " << std::setw(7) << nsAlias << " ns"
+			<< "  speedup: " << nsSearch / nsAlias << endl;
+	}
+
+	//Both samplers must follow the same distribution. Compare the empirical frequencies for the white/black piece counts
+	vector<int64_t> hits(16 * 16, 0);
+	for (int64_t x = 0; x < DRAWS; x++)
+		hits[lp.pickAlias(lp.aliasCombsWB)]++;
+
+	double worst = 0;
+	for (const auto& c : lp.combsWB)
+	{
+		double expected = c.val / lp.combsSumWB * DRAWS;
+		if (expected >= 10'000)
+			worst = std::max(worst, std::abs(hits[c.idx] - expected) / sqrt(expected));
+	}
+	cout << "PIECES_WB alias frequencies: worst deviation " << worst << " standard deviations" << endl;
+	cout << "(" << sink << ")" << endl;
+}
+
+
+//Draws of one PIECES_WB-like sample: piece counts, 30 pieces, kings and 30 squares
+template<typename TDraw>
+static uint64_t syntheticSample(TDraw&& draw)
+{
+	uint64_t acc = draw(256);
+	for (int q = 0; q < 30; q++)
+		acc += draw(5);
+	acc += draw(3612);
+	for (int q = 0; q < 30; q++)
+		acc += draw(62 - q);
+	return acc;
+}
+
+
+template<typename TGen>
+static void benchOneGenerator(const string& name, uint64_t& sink)
+{
+	const int64_t WORDS = 200'000'000;
+	const int64_t SAMPLES = 5'000'000;
+	RandBuffer<TGen> rb{ TGen(12941865) };
+	uint64_t acc = 0;		//Local, so that it can't alias the buffer
+
+	auto start = std::chrono::steady_clock::now();
+	for (int64_t x = 0; x < WORDS; x++)
+		acc += rb.next();
+	std::chrono::duration<double> wordsTime = std::chrono::steady_clock::now() - start;
+
+	start = std::chrono::steady_clock::now();
+	for (int64_t x = 0; x < SAMPLES; x++)
+	{
+		rb.reserve(LegalParams::MAX_DRAWS_PER_SAMPLE);
+		acc += syntheticSample([&](uint64_t range) { return rb.bounded(range); });
+	}
+	std::chrono::duration<double> samplesTime = std::chrono::steady_clock::now() - start;
+	sink += acc;
+
+	cout << std::setw(20) << name << "  words/s: " << std::setw(12) << WORDS / wordsTime.count()
+		<< "  samples/s: " << std::setw(12) << SAMPLES / samplesTime.count() << endl;
+}
+
+
+//Random number generation alone and in prepare(), for every generator usable as bufferGen
+void Runner::benchRandom(int argc, char* argv[])
+{
+	uint64_t sink = 0;
+	cout << endl << "Buffered generators (Lemire bounded draws, synthetic 62-draw samples)" << endl;
+	benchOneGenerator<xoshiro256x8>("xoshiro256x8", sink);
+	benchOneGenerator<pcg64>("pcg64", sink);
+	benchOneGenerator<jsf64>("jsf64", sink);
+	benchOneGenerator<sfc64>("sfc64", sink);
+	benchOneGenerator<xoroshiro128plus64>("xoroshiro128plus64", sink);
+	benchOneGenerator<gjrand64>("gjrand64", sink);
+
+	//What every draw used to cost: a distribution object and a pcg64 call
+	{
+		const int64_t SAMPLES = 5'000'000;
+		pcg64 gen(12941865);
+		auto start = std::chrono::steady_clock::now();
+		for (int64_t x = 0; x < SAMPLES; x++)
+			sink += syntheticSample([&](uint64_t range)
+			{
+				std::uniform_int_distribution<int> distribution(0, int(range - 1));
+				return uint64_t(distribution(gen));
+			});
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		cout << std::setw(20) << "pcg64 unbuffered" << "  samples/s: " << SAMPLES / elapsed.count() << endl;
+	}
+
+	LegalParams lp;
+	if (!lp.setup(argc, argv, 1))
+		return;
+	const int64_t SAMPLES = 5'000'000;
+	LegalChecker lc;
+	lc.init(&lp, 0);
+	auto start = std::chrono::steady_clock::now();
+	for (int64_t x = 0; x < SAMPLES; x++)
+		sink += lc.prepare<ESampleType::PIECES_WB>();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	cout << "prepare<PIECES_WB> with bufferGen: " << SAMPLES / elapsed.count() << " samples/s" << endl;
+	cout << "(" << sink << ")" << endl;
+}
+
+
+void validate(LegalParams& lp);
+
+
+//Legality checks on LeanBoard vs full SF positions, on the same stream of samples
+void Runner::benchLegal(int argc, char* argv[])
+{
+	LegalParams lp;
+	if (!lp.setup(argc, argv, 1))
+		return;
+	const int64_t SAMPLES = 5'000'000;
+	const uint64_t SEED = 8734511;
+
+	enum class EPass { PREPARE_ONLY, SF_POSITIONS, LEAN_BOARD };
+	auto runPass = [&](EPass pass)
+	{
+		lp.leanBoard = pass != EPass::SF_POSITIONS;
+		lp.rbufs[0] = RandBuffer<bufferGen>(bufferGen(SEED));
+		LegalChecker lc;
+		lc.init(&lp, 0);
+		double legal = 0;
+		auto start = std::chrono::steady_clock::now();
+		for (int64_t x = 0; x < SAMPLES; x++)
+		{
+			if (!lc.prepare<ESampleType::PIECES_WB>() || pass == EPass::PREPARE_ONLY)
+				continue;
+			lc.createTotalCounts();
+			if (lc.checkConditions())
+				legal += lc.getSampleWeight();
+		}
+		std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+		return std::make_pair(elapsed.count() / SAMPLES, legal);
+	};
+
+	for (bool lean : { false, true })
+	{
+		lp.leanBoard = lean;
+		validate(lp);
+	}
+
+	const double nsPrepare = runPass(EPass::PREPARE_ONLY).first;
+	const auto [nsSF, legalSF] = runPass(EPass::SF_POSITIONS);
+	const auto [nsLean, legalLean] = runPass(EPass::LEAN_BOARD);
+
+	cout << endl << "Legality checks, " << SAMPLES << " PIECES_WB samples" << endl;
+	cout << "prepare only:  " << nsPrepare << " ns/sample" << endl;
+	cout << "SF positions:  " << nsSF << " ns/sample  checks: " << nsSF - nsPrepare << " ns/sample  legal: " << legalSF << endl;
+	cout << "LeanBoard:     " << nsLean << " ns/sample  checks: " << nsLean - nsPrepare << " ns/sample  legal: " << legalLean << endl;
+	cout << "Speedup of the checks: " << (nsSF - nsPrepare) / (nsLean - nsPrepare) << endl;
+	if (legalSF != legalLean)
+		cout << "ERROR: the two paths disagree" << endl;
+}
+
+
+//Packed positions vs FENs: encoding, decoding, and feeding a saved dataset back into the legality checks
+void Runner::benchCodec(int argc, char* argv[])
+{
+	LegalParams lp;
+	if (!lp.setup(argc, argv, 1))
+		return;
+	const int64_t POSITIONS = std::stoll(optionValue(argc, argv, "--positions", "200000"));
+	const string fname = optionValue(argc, argv, "--out", "bench-codec.bin");
+	auto nsPer = [&](auto start) { return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / POSITIONS; };
+
+	vector<string> fens;
+	vector<PackedPosition> packed;
+	{
+		LegalChecker lc;
+		lc.init(&lp, 0);
+		PositionWriter writer(fname, EPositionFormat::PACKED, false, 1);
+		if (!writer.isOpen())
+			return;
+		while (int64_t(fens.size()) < POSITIONS)
+		{
+			if (!lc.prepareMateVarious())
+				continue;
+			lc.createTotalCounts();
+			if (!lc.checkConditions())
+				continue;
+			fens.push_back(lc.fen());
+			packed.push_back(PackedPosition::pack(lc.position()));
+			writer.add(0, lc.position());
+		}
+		writer.close();
+	}
+
+	//Encoding and decoding alone. Packing cycles through a small set of positions, to stay in the cache like the FENs do
+	const int64_t SET_POSITIONS = std::min<int64_t>(POSITIONS, 4096);
+	Position pos;
+	vector<Position> positions(SET_POSITIONS);
+	vector<StateInfo> states(SET_POSITIONS + 1);
+	for (int64_t x = 0; x < SET_POSITIONS; x++)
+		positions[x].set(fens[x], false, &states[x], Threads.main());
+	uint64_t sink = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int64_t x = 0; x < POSITIONS; x++)
+		sink += PackedPosition::pack(positions[x % SET_POSITIONS]).codes[x & 15];
+	const double nsPack = nsPer(start);
+
+	CodeBoard codes;
+	start = std::chrono::steady_clock::now();
+	for (const auto& pp : packed)
+	{
+		pp.toCodes(codes);
+		sink += codes[pp.occupied & 63];
+	}
+	const double nsUnpack = nsPer(start);
+
+	start = std::chrono::steady_clock::now();
+	for (const auto& fen : fens)
+		sink += pos.set(fen, false, &states[SET_POSITIONS], Threads.main()).key();
+	const double nsSet = nsPer(start);
+
+	//The same checks from FENs, from the packed positions in memory and from the mapped file
+	LegalChecker lc;
+	lc.init(&lp, 0);
+	auto check = [&]()
+	{
+		lc.createCounts();
+		lc.createTotalCounts();
+		return lc.checkConditions();
+	};
+
+	int64_t legalFen = 0, legalPacked = 0, legalMapped = 0;
+	start = std::chrono::steady_clock::now();
+	for (const auto& fen : fens)
+	{
+		lc.fromFen(fen);
+		legalFen += check();
+	}
+	const double nsFen = nsPer(start);
+
+	start = std::chrono::steady_clock::now();
+	for (const auto& pp : packed)
+	{
+		lc.fromPacked(pp);
+		legalPacked += check();
+	}
+	const double nsPacked = nsPer(start);
+
+	MappedPositionFile file;
+	if (!file.open(fname))
+		return;
+	vector<PackedPosition> scratch;
+	start = std::chrono::steady_clock::now();
+	for (const auto& block : file.getBlocks())
+	{
+		const PackedPosition* blockPositions = file.blockPositions(block, scratch);
+		for (uint32_t q = 0; q < block.positions; q++)
+		{
+			lc.fromPacked(blockPositions[q]);
+			legalMapped += check();
+		}
+	}
+	const double nsMapped = nsPer(start);
+
+	int64_t mismatches = 0;
+	for (int64_t x = 0; x < POSITIONS; x++)
+		mismatches += packed[x].fen() != fens[x];
+
+	cout << endl << "Position codec, " << POSITIONS << " legal positions" << endl;
+	cout << "pack:                  " << nsPack << " ns/position" << endl;
+	cout << "unpack:                " << nsUnpack << " ns/position" << endl;
+	cout << "Position::set:         " << nsSet << " ns/position" << endl;
+	cout << "checks from FENs:      " << nsFen << " ns/position  legal: " << legalFen << endl;
+	cout << "checks from packed:    " << nsPacked << " ns/position  legal: " << legalPacked << endl;
+	cout << "checks from " << fname << ": " << nsMapped << " ns/position  legal: " << legalMapped << "  (" << file.getPositions() << " in the file)" << endl;
+	if (mismatches || legalFen != legalPacked || legalFen != legalMapped || file.getPositions() != POSITIONS)
+		cout << "ERROR: " << mismatches << " positions don't round-trip, or the paths disagree" << endl;
+	cout << "(" << sink << ")" << endl;
+}
+
+
+//MateSolver vs LegalChecker::isMate on the same legal positions: agreement, time and nodes
+void Runner::benchMate(int argc, char* argv[])
+{
+	LegalParams lp;
+	if (!lp.setup(argc, argv, 1))
+		return;
+	const int64_t POSITIONS = std::stoll(optionValue(argc, argv, "--positions", "2000"));
+	const int moves = std::stoi(optionValue(argc, argv, "--moves", "2"));
+
+	LegalChecker lc;
+	lc.init(&lp, 0);
+	MateSolver solver(64);
+	StateInfo st;
+	Position pos;
+	int64_t matesOld = 0, matesNew = 0, mismatches = 0;
+	double secondsOld = 0, secondsNew = 0;
+	for (int64_t x = 0; x < POSITIONS; )
+	{
+		if (!lc.prepareMateVarious())
+			continue;
+		lc.createTotalCounts();
+		if (!lc.checkConditions())
+			continue;
+		x++;
+
+		auto start = std::chrono::steady_clock::now();
+		const bool mateOld = lc.isMate(moves, false);
+		std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		secondsOld += elapsed.count();
+
+		const string fen = lc.fen();
+		pos.set(fen, false, &st, Threads.main());
+		start = std::chrono::steady_clock::now();
+		const bool mateNew = solver.isMate(pos, moves);
+		elapsed = std::chrono::steady_clock::now() - start;
+		secondsNew += elapsed.count();
+
+		matesOld += mateOld;
+		matesNew += mateNew;
+		if (mateOld != mateNew)
+		{
+			mismatches++;
+			cout << "Mismatch: " << fen << "  isMate: " << mateOld << "  MateSolver: " << mateNew << endl;
+		}
+	}
+
+	cout << endl << "Mate in " << moves << ", " << POSITIONS << " legal positions" << endl;
+	cout << "LegalChecker::isMate: " << secondsOld << " s  mates: " << matesOld << endl;
+	cout << "MateSolver:           " << secondsNew << " s  mates: " << matesNew << "  nodes: " << solver.getNodes() << endl;
+	cout << "Speedup: " << secondsOld / secondsNew << endl;
+	if (mismatches)
+		cout << "ERROR: " << mismatches << " positions disagree" << endl;
+}
+
+
+//Stages of one sample in posEstimate, timed by bench-counter. checkConditions includes createTotalCounts. setSFPositions
+//isn't part of the sampling loop with LeanBoard, it is timed on the legal samples to show what a full SF position costs
+enum EStage { STAGE_PREPARE, STAGE_CHECK_CONDITIONS, STAGE_SF_POSITIONS, STAGE_CASTLING, STAGE_EN_PASSANT, STAGE_ADDITIONAL, STAGE_NB };
+
+constexpr std::array<const char*, STAGE_NB> STAGE_NAMES =
+	{ "prepare", "checkConditions", "setSFPositions", "countCastling", "countEnPassantPossibilities", "checkAdditionalConditions" };
+
+struct StageTimes
+{
+	std::array<uint64_t, STAGE_NB> cycles{};
+	std::array<int64_t, STAGE_NB> calls{};
+};
+
+
+//The work of posEstimate's loop for samples samples on the calling thread, split into stages so they can be timed.
+//Returns the legal count, the same for the same random streams, which benchSampleType compares with countSample's.
+//With timed, the cycles of every stage are added to times
+template<ESampleType sampleType, bool timed>
+static double sampleLoop(LegalChecker& lc, const RestrictionProfile& profile, int64_t samples, StageTimes& times)
+{
+	auto stage = [&](EStage s, auto&& f)
+	{
+		if constexpr (!timed)
+			return f();
+		else
+		{
+			const uint64_t start = cycleCount();
+			const auto res = f();
+			times.cycles[s] += cycleCount() - start;
+			times.calls[s]++;
+			return res;
+		}
+	};
+
+	constexpr bool restrictedType = sampleType != ESampleType::PIECES_WB && sampleType != ESampleType::PIECES;
+	double legal = 0;
+	for (int64_t x = 0; x < samples; x++)
+	{
+		if (!stage(STAGE_PREPARE, [&]() { return lc.prepare<sampleType>(); }))
+			continue;
+		if (!stage(STAGE_CHECK_CONDITIONS, [&]() { lc.createTotalCounts(); return lc.checkConditions(); }))
+			continue;
+		const int castlingMult = stage(STAGE_CASTLING, [&]() { return lc.countCastling(); });
+		const int epPoss = stage(STAGE_EN_PASSANT, [&]() { return lc.countEnPassantPossibilities(); });
+		const bool isokRestricted = stage(STAGE_ADDITIONAL, [&]() { return lc.checkAdditionalConditions(profile); });
+		if (!restrictedType || isokRestricted)
+			legal += lc.getSampleWeight() * castlingMult * (1 + epPoss);
+		if constexpr (timed)
+			stage(STAGE_SF_POSITIONS, [&]() { lc.setSFPositions(); return true; });
+	}
+	return legal;
+}
+
+
+//Every thread back to the start of its random streams, so every pass sees the same samples
+static void resetStreams(LegalParams& lp)
+{
+	for (int t = 0; t < int(lp.rbufs.size()); t++)
+	{
+		lp.rgensPCG[t] = makeStreamGen<randGen>(LegalParams::SEED, 0, t, LegalParams::MAX_STREAMS_PER_SHARD);
+		lp.rbufs[t] = RandBuffer<bufferGen>(makeStreamGen<bufferGen>(LegalParams::SEED, 0, t, LegalParams::MAX_STREAMS_PER_SHARD));
+	}
+}
+
+
+using BenchSummary = vector<std::pair<string, double>>;
+
+//One thread: samples/s untimed, then ns per call of every stage in a second, timed pass over the same samples. A third
+//pass runs posEstimate's own countSample over the same samples on the warmed-up checker: it must count the same and not
+//allocate. False if it doesn't
+template<ESampleType sampleType>
+[[nodiscard]] static bool benchSampleType(const Runner& runner, LegalParams& lp, int64_t samples, BenchSummary& summary)
+{
+	const string name = SAMPLE_TYPE_NAMES[int(sampleType)];
+	StageTimes times;
+	LegalChecker lc;
+	lc.init(&lp, 0);
+
+	resetStreams(lp);
+	auto start = std::chrono::steady_clock::now();
+	const double legal = sampleLoop<sampleType, false>(lc, lp.profile, samples, times);
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+	const double samplesPerSecond = samples / elapsed.count();
+
+	resetStreams(lp);
+	start = std::chrono::steady_clock::now();
+	const uint64_t startCycles = cycleCount();
+	const double legalTimed = sampleLoop<sampleType, true>(lc, lp.profile, samples, times);
+	const double nsPerCycle = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+		/ double(cycleCount() - startCycles);
+
+	resetStreams(lp);
+	auto st = std::make_unique<EstimateStats>();
+	st->setSizes(EstimateStats::MAX_OPENINGS, lp.extraProfiles.size());
+	const int64_t startAllocations = threadAllocations();
+	for (int64_t x = 0; x < samples; x++)
+		runner.countSample<sampleType>(lc, lp, *st, -1, 1.0);
+	const int64_t allocations = threadAllocations() - startAllocations;
+	constexpr bool restrictedType = sampleType != ESampleType::PIECES_WB && sampleType != ESampleType::PIECES;
+	const double legalCounted = restrictedType ? st->legalRestricted.get() : st->legal.get();
+
+	cout << endl << name << ": " << std::setw(10) << int64_t(samplesPerSecond) << " samples/s  legal: " << legal << endl;
+	summary.emplace_back(name + ".samplesPerSecond", samplesPerSecond);
+	summary.emplace_back(name + ".legal", legal);
+	for (int s = 0; s < STAGE_NB; s++)
+	{
+		const double ns = times.calls[s] ? times.cycles[s] * nsPerCycle / times.calls[s] : 0;
+		cout << std::setw(30) << STAGE_NAMES[s] << ": " << std::setw(8) << ns << " ns  calls per sample: "
+			<< double(times.calls[s]) / samples << endl;
+		summary.emplace_back(name + ".ns." + STAGE_NAMES[s], ns);
+	}
+	cout << std::setw(30) << "heap allocations" << ": " << allocations << endl;
+	summary.emplace_back(name + ".allocations", double(allocations));
+	bool ok = true;
+	if (legalTimed != legal || legalCounted != legal)
+	{
+		cout << "ERROR: the passes drew different samples, or countSample counts differently" << endl;
+		ok = false;
+	}
+	if (allocations != 0)
+	{
+		cout << "ERROR: countSample allocated " << double(allocations) / samples << " times per sample" << endl;
+		ok = false;
+	}
+	return ok;
+}
+
+
+//bench-counter [--samples N] [--threads N] [--out FILE] [--compare FILE]: fixed-seed throughput of the sampling loop for
+//every sample type, the cost of each stage, and PIECES_WB samples/s from 1 to N threads, each drawing N samples. Ends with
+//a "key value" summary, which --out saves and --compare puts next to an earlier one. False, for a failing exit code, if a
+//sample type's posEstimate path allocates or disagrees with the sampling loop
+bool Runner::benchCounter(int argc, char* argv[])
+{
+	const int maxThreads = std::stoi(optionValue(argc, argv, "--threads", std::to_string(omp_get_max_threads())));
+	omp_set_num_threads(maxThreads);
+	LegalParams lp;
+	if (!lp.setup(argc, argv, maxThreads))
+		return false;
+	const int64_t samples = std::stoll(optionValue(argc, argv, "--samples", "2000000"));
+	validate(lp);
+
+	BenchSummary summary;
+	summary.emplace_back("samples", double(samples));
+	summary.emplace_back("threads", double(maxThreads));
+	cout << endl << "Sampling loop, " << samples << " samples per sample type on one thread" << endl;
+	bool ok = benchSampleType<ESampleType::PIECES>(*this, lp, samples, summary);
+	ok &= benchSampleType<ESampleType::PIECES_WB>(*this, lp, samples, summary);
+	ok &= benchSampleType<ESampleType::WB_RESTRICTED>(*this, lp, samples, summary);
+	ok &= benchSampleType<ESampleType::RESTRICTED>(*this, lp, samples, summary);
+
+	//VERY_RESTRICTED draws from its own profile, set up as posEstimate does with --sample-type VERY_RESTRICTED
+	vector<char*> veryArgs(argv, argv + argc);
+	string sampleTypeOption = "--sample-type", veryRestricted = "VERY_RESTRICTED";
+	veryArgs.insert(veryArgs.begin() + 2, { sampleTypeOption.data(), veryRestricted.data() });
+	LegalParams lpVery;
+	if (!lpVery.setup(int(veryArgs.size()), veryArgs.data(), maxThreads))
+		return false;
+	ok &= benchSampleType<ESampleType::VERY_RESTRICTED>(*this, lpVery, samples, summary);
+
+	//Doubling up to maxThreads, which is always included
+	vector<int> threadCounts;
+	for (int n = 1; n < maxThreads; n *= 2)
+		threadCounts.push_back(n);
+	threadCounts.push_back(maxThreads);
+
+	cout << endl << "PIECES_WB scaling, " << samples << " samples per thread" << endl;
+	double single = 0;
+	for (int n : threadCounts)
+	{
+		resetStreams(lp);
+		const auto start = std::chrono::steady_clock::now();
+#pragma omp parallel num_threads(n)
+		{
+			StageTimes unused;
+			LegalChecker lc;
+			lc.init(&lp, omp_get_thread_num());
+			(void)sampleLoop<ESampleType::PIECES_WB, false>(lc, lp.profile, samples, unused);
+		}
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+		const double samplesPerSecond = n * samples / elapsed.count();
+		if (n == 1)
+			single = samplesPerSecond;
+		cout << std::setw(4) << n << " threads: " << std::setw(12) << int64_t(samplesPerSecond) << " samples/s  per thread: "
+			<< std::setw(10) << int64_t(samplesPerSecond / n) << "  efficiency: " << samplesPerSecond / (n * single) << endl;
+		summary.emplace_back("scaling." + std::to_string(n), samplesPerSecond);
+	}
+
+	cout << endl << "Summary" << endl;
+	for (const auto& [key, value] : summary)
+		cout << key << ' ' << value << endl;
+
+	const string outFile = optionValue(argc, argv, "--out");
+	if (!outFile.empty())
+	{
+		std::ofstream f(outFile, std::ios::trunc);
+		f.precision(std::numeric_limits<double>::max_digits10);
+		f << BENCH_HEADER << '\n';
+		for (const auto& [key, value] : summary)
+			f << key << ' ' << value << '\n';
+		if (!f)
+			cout << "Could not write " << outFile << endl;
+	}
+
+	const string compareFile = optionValue(argc, argv, "--compare");
+	if (!compareFile.empty())
+	{
+		std::ifstream f(compareFile);
+		string line;
+		if (!std::getline(f, line) || line != BENCH_HEADER)
+		{
+			cout << "Not a bench-counter summary: " << compareFile << endl;
+			return false;
+		}
+		std::map<string, double> old;
+		string key;
+		double value;
+		while (f >> key >> value)
+			old[key] = value;
+		cout << endl << "Compared with " << compareFile << ": new / old" << endl;
+		for (const auto& [k, v] : summary)
+			if (old.count(k) && old[k] != 0)
+				cout << std::setw(50) << k << ": " << std::setw(12) << v << " / " << std::setw(12) << old[k] << " = " << v / old[k] << endl;
+	}
+	return ok;
+}
+
+
+//The board part of fen with a symmetry of LegalParams::transformSquare applied, optionally without pawns
+static string transformFen(const string& fen, int symmetry, bool dropPawns)
+{
+	std::array<char, SQUARE_NB> board;
+	board.fill(' ');
+	int f = 0, r = 7;
+	for (char c : fen.substr(0, fen.find(' ')))
+	{
+		if (c == '/')
+		{
+			f = 0;
+			r--;
+		}
+		else if (c >= '1' && c <= '8')
+			f += c - '0';
+		else
+		{
+			if (!dropPawns || (c != 'P' && c != 'p'))
+				board[LegalParams::transformSquare(make_square(File(f), Rank(r)), symmetry)] = c;
+			f++;
+		}
+	}
+
+	string res;
+	for (int rank = 7; rank >= 0; rank--)
+	{
+		int empty = 0;
+		for (int file = 0; file < 8; file++)
+		{
+			const char c = board[make_square(File(file), Rank(rank))];
+			if (c == ' ')
+				empty++;
+			else
+			{
+				if (empty)
+					res += char('0' + empty);
+				empty = 0;
+				res += c;
+			}
+		}
+		if (empty)
+			res += char('0' + empty);
+		if (rank)
+			res += '/';
+	}
+	return res + " w - - 0 1";
+}
+
+
+//Does every symmetry of the board leave the checks' verdict and weight alone? Positions with pawns are compared with
+//their mirror image, pawnless ones (the same samples without pawns) with all 8 symmetries. Pairs of king squares where
+//LegalParams::castlingRelevant says castling could make a difference are skipped. RESTRICTED samples with up to 20 pieces,
+//so that many of them are legal
+void Runner::checkSymmetry(int argc, char* argv[])
+{
+	LegalParams lp;
+	if (!lp.setup(argc, argv, 1))
+		return;
+	lp.setupStrata();
+	const int64_t SAMPLES = std::stoll(optionValue(argc, argv, "--samples", "200000"));
+
+	auto evaluate = [&](const string& fen)
+	{
+		LegalChecker lc;
+		lc.init(&lp, 0);
+		lc.fromFen(fen);
+		lc.createCounts();
+		lc.createTotalCounts();
+		if (!lc.checkConditions())
+			return 0.0;
+		return double(lc.countCastling() * (1 + lc.countEnPassantPossibilities()));
+	};
+
+	std::array<std::array<int64_t, 8>, 2> compared = {}, mismatches = {};
+	int64_t legal = 0;
+	LegalChecker lc;
+	lc.init(&lp, 0);
+	for (int64_t x = 0; x < SAMPLES; x++)
+	{
+		lc.setStratum(int(x % 19));
+		if (!lc.prepare<ESampleType::RESTRICTED>())
+			continue;
+		const string fen = lc.fen();
+		for (int pawns = 0; pawns < 2; pawns++)
+		{
+			const string base = transformFen(fen, 0, pawns == 0);
+			const double value = evaluate(base);
+			legal += value > 0;
+			const auto [wk, bk] = lc.getKings();
+			if (LegalParams::castlingRelevant(wk, bk))
+				continue;
+			for (int s = 1; s < (pawns ? 2 : 8); s++)
+			{
+				if (LegalParams::castlingRelevant(LegalParams::transformSquare(wk, s), LegalParams::transformSquare(bk, s)))
+					continue;
+				const string image = transformFen(fen, s, pawns == 0);
+				compared[pawns][s]++;
+				if (evaluate(image) != value)
+				{
+					if (mismatches[pawns][s]++ < 3)
+						cout << "Mismatch, symmetry " << s << ": " << base << "  " << image << endl;
+				}
+			}
+		}
+	}
+
+	cout << endl << "Symmetry check, " << SAMPLES << " RESTRICTED samples, " << legal << " legal boards" << endl;
+	for (int pawns = 0; pawns < 2; pawns++)
+		for (int s = 1; s < (pawns ? 2 : 8); s++)
+			cout << (pawns ? "with pawns" : "pawnless  ") << "  symmetry " << s << ":  compared: " << compared[pawns][s]
+				<< "  mismatches: " << mismatches[pawns][s] << endl;
+}
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <string>
 #include <omp.h>
 #include "bitboard.h"
 #include "endgame.h"
@@ -9,16 +10,59 @@
 #include "uci.h"
 #include "syzygy/tbprobe.h"
 #include "runner.h"
+#include "Options.h"
 
 
 int main(int argc, char* argv[])
 {
 	omp_set_nested(2);
+	int exitCode = 0;
 	Runner runner;
 	runner.init();
-	//runner.generateFens(argc, argv, "b:/outd/mates-various14.txt");
-	runner.posEstimate<ESampleType::PIECES_WB>(argc, argv);
+	const std::string command = argc > 1 ? argv[1] : "";
+	if (command == "bench-sampler")
+		runner.benchSampler(argc, argv);
+	else if (command == "bench-random")
+		runner.benchRandom(argc, argv);
+	else if (command == "bench-legal")
+		runner.benchLegal(argc, argv);
+	else if (command == "bench-codec")
+		runner.benchCodec(argc, argv);
+	else if (command == "bench-mate")
+		runner.benchMate(argc, argv);
+	else if (command == "bench-counter")
+		exitCode = runner.benchCounter(argc, argv) ? 0 : 1;
+	else if (command == "check-symmetry")
+		runner.checkSymmetry(argc, argv);
+	else if (command == "merge")
+		runner.merge(argc, argv);
+	else if (command == "generate-fens")
+		runner.generateFens(argc, argv);
+	else if (command == "positions-to-fen")
+		runner.positionsToFen(argc, argv);
+	else if (command == "revalidate")
+		runner.revalidate(argc, argv);
+	else if (command == "replay")
+		runner.replay(argc, argv);
+	else if (command == "mate-search")
+		runner.mateSearch(argc, argv);
+	else
+	{
+		//--sample-type NAME: which estimate to run, PIECES_WB by default
+		const std::string sampleType = optionValue(argc, argv, "--sample-type", "PIECES_WB");
+		if (sampleType == "PIECES")
+			runner.posEstimate<ESampleType::PIECES>(argc, argv);
+		else if (sampleType == "WB_RESTRICTED")
+			runner.posEstimate<ESampleType::WB_RESTRICTED>(argc, argv);
+		else if (sampleType == "RESTRICTED")
+			runner.posEstimate<ESampleType::RESTRICTED>(argc, argv);
+		else if (sampleType == "VERY_RESTRICTED")
+			runner.posEstimate<ESampleType::VERY_RESTRICTED>(argc, argv);
+		else
+			runner.posEstimate<ESampleType::PIECES_WB>(argc, argv);
+	}
 
 	Threads.set(0);
+	return exitCode;
 }
 
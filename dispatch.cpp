@@ -0,0 +1,47 @@
+#include <unistd.h>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+//ChessCounter of the CMake build: runs the fastest ChessCounter-<isa> next to it that this CPU supports, with the same
+//arguments. CHESSCOUNTER_ISA=<isa> picks a variant instead, e.g. to compare them
+int main(int argc, char* argv[])
+{
+	struct Variant
+	{
+		const char* isa;
+		bool supported;
+	};
+	__builtin_cpu_init();
+	const Variant variants[] = {
+		{ "avx512", bool(__builtin_cpu_supports("x86-64-v4")) },
+		{ "avx2", bool(__builtin_cpu_supports("x86-64-v3")) },
+		{ "x86-64-v2", bool(__builtin_cpu_supports("x86-64-v2")) },
+	};
+
+	std::string dir = ".";
+	char self[4096];
+	const ssize_t len = readlink("/proc/self/exe", self, sizeof(self) - 1);
+	if (len > 0)
+	{
+		dir.assign(self, len);
+		dir.erase(dir.find_last_of('/'));
+	}
+
+	const char* forced = std::getenv("CHESSCOUNTER_ISA");
+	for (const auto& v : variants)
+	{
+		if (forced ? std::string(forced) != v.isa : !v.supported)
+			continue;
+		const std::string path = dir + "/ChessCounter-" + v.isa;
+		if (access(path.c_str(), X_OK) != 0)
+			continue;
+		argv[0] = const_cast<char*>(path.c_str());
+		execv(path.c_str(), argv);
+		std::cerr << "Could not run " << path << std::endl;
+		return 1;
+	}
+	std::cerr << "No ChessCounter-<isa> binary for this CPU" << (forced ? std::string(" and CHESSCOUNTER_ISA=") + forced : "") << " in " << dir << std::endl;
+	return 1;
+}
@@ -0,0 +1,126 @@
+#ifndef XOSHIRO256SIMD_HPP_INCLUDED
+#define XOSHIRO256SIMD_HPP_INCLUDED 1
+
+/*
+ * Several independent xoshiro256** generators (Blackman & Vigna) stepped in
+ * lock-step. The state is kept as structure-of-arrays so that the inner loop
+ * over lanes compiles to AVX2/AVX-512 code. The multiplications by 5 and 9
+ * are written as shifts and adds because AVX2 has no 64-bit multiply.
+ *
+ * Only block output is provided (fill). Use it through RandBuffer.
+ */
+
+#include <cstdint>
+#include <cstddef>
+
+template <int LANES>
+class xoshiro256simd {
+    alignas(64) uint64_t s0_[LANES], s1_[LANES], s2_[LANES], s3_[LANES];
+
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    static uint64_t splitmix64(uint64_t& x)
+    {
+        uint64_t z = (x += 0x9e3779b97f4a7c15ULL);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    static void step(uint64_t s[4])
+    {
+        const uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+    }
+
+    static void jump(uint64_t s[4], const uint64_t (&poly)[4])
+    {
+        uint64_t j[4] = { 0, 0, 0, 0 };
+        for (int w = 0; w < 4; ++w)
+            for (int b = 0; b < 64; ++b) {
+                if (poly[w] & (uint64_t(1) << b))
+                    for (int q = 0; q < 4; ++q)
+                        j[q] ^= s[q];
+                step(s);
+            }
+        for (int q = 0; q < 4; ++q)
+            s[q] = j[q];
+    }
+
+public:
+    using result_type = uint64_t;
+    static constexpr int lanes = LANES;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return ~ result_type(0); }
+
+    xoshiro256simd(uint64_t seed = 0xcafef00dbeef5eedULL)
+    {
+        uint64_t x = seed;
+        for (int l = 0; l < LANES; ++l) {
+            s0_[l] = splitmix64(x);
+            s1_[l] = splitmix64(x);
+            s2_[l] = splitmix64(x);
+            s3_[l] = splitmix64(x);
+        }
+    }
+
+    // Non-overlapping generators: lane l of generator `minor` in family
+    // `major` starts major long jumps (2^192 steps) plus minor * LANES + l
+    // jumps (2^128 steps) after the seed
+    static xoshiro256simd fromStream(uint64_t seed, uint64_t major, uint64_t minor)
+    {
+        static constexpr uint64_t JUMP[4] = { 0x180ec6d33cfd0abaULL,
+            0xd5a61266f0c9392cULL, 0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL };
+        static constexpr uint64_t LONG_JUMP[4] = { 0x76e15d3efefdcbbfULL,
+            0xc5004e441c522fb3ULL, 0x77710069854ee241ULL, 0x39109bb02acbe635ULL };
+
+        uint64_t x = seed;
+        uint64_t s[4] = { splitmix64(x), splitmix64(x), splitmix64(x), splitmix64(x) };
+        for (uint64_t q = 0; q < major; ++q)
+            jump(s, LONG_JUMP);
+        for (uint64_t q = 0; q < minor * LANES; ++q)
+            jump(s, JUMP);
+
+        xoshiro256simd gen;
+        for (int l = 0; l < LANES; ++l) {
+            gen.s0_[l] = s[0];
+            gen.s1_[l] = s[1];
+            gen.s2_[l] = s[2];
+            gen.s3_[l] = s[3];
+            jump(s, JUMP);
+        }
+        return gen;
+    }
+
+    // n must be a multiple of LANES
+    void fill(uint64_t* out, size_t n)
+    {
+        for (size_t i = 0; i < n; i += LANES) {
+            for (int l = 0; l < LANES; ++l) {
+                uint64_t x = s1_[l] + (s1_[l] << 2);    // s1 * 5
+                x = rotl(x, 7);
+                out[i + l] = x + (x << 3);              // * 9
+                uint64_t t = s1_[l] << 17;
+                s2_[l] ^= s0_[l];
+                s3_[l] ^= s1_[l];
+                s1_[l] ^= s2_[l];
+                s0_[l] ^= s3_[l];
+                s2_[l] ^= t;
+                s3_[l] = rotl(s3_[l], 45);
+            }
+        }
+    }
+};
+
+using xoshiro256x8 = xoshiro256simd<8>;
+
+#endif // XOSHIRO256SIMD_HPP_INCLUDED
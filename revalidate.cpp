@@ -0,0 +1,384 @@
+#include "runner.h"
+#include "LegalChecker.h"
+#include "LegalParams.h"
+#include "Options.h"
+#include "PositionFile.h"
+#include "RestrictionProfile.h"
+#include <omp.h>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+using std::vector;
+using std::cout;
+using std::endl;
+using std::string;
+
+
+//What revalidate and replay say about a position: the rule that rejected it (ERule), or one of these.
+//VERDICT_WHITE_IN_CHECK is RULE_BLACK_IN_CHECK on a black-to-move position, which is checked with the colors swapped
+enum EVerdict { VERDICT_LEGAL = RULE_NB, VERDICT_PROFILE, VERDICT_BAD_INPUT, VERDICT_NOT_DRAWN, VERDICT_WHITE_IN_CHECK, VERDICT_NB };
+
+static const char* verdictName(int verdict)
+{
+	switch (verdict)
+	{
+	case VERDICT_LEGAL: return "legal";
+	case VERDICT_PROFILE: return "profile";
+	case VERDICT_BAD_INPUT: return "bad input";
+	case VERDICT_NOT_DRAWN: return "rejected in prepare";
+	case VERDICT_WHITE_IN_CHECK: return "white in check";
+	default: return RULE_NAMES[verdict];
+	}
+}
+
+
+static const size_t TEXT_CHUNK_BYTES = 1 << 20;		//Text input is split into chunks of about this size, at line ends
+
+
+//The checks are for white to move. A black-to-move position is the same as its mirror image with the colors swapped
+static void mirrorColors(PieceBoard& placed, Bitboard& occupied)
+{
+	PieceBoard mirrored;
+	Bitboard mirroredOccupied = 0;
+	for (Bitboard b = occupied; b; )
+	{
+		const Square sq = pop_lsb(&b);
+		mirrored[flip_rank(sq)] = ~placed[sq];
+		mirroredOccupied |= square_bb(flip_rank(sq));
+	}
+	placed = mirrored;
+	occupied = mirroredOccupied;
+}
+
+
+//parseFenBoard, with a black-to-move board mirrored for the checks
+static bool readFenBoard(const char* p, const char* end, PieceBoard& placed, Bitboard& occupied, bool& blackToMove)
+{
+	if (!parseFenBoard(p, end, placed, occupied, blackToMove))
+		return false;
+	if (blackToMove)
+		mirrorColors(placed, occupied);
+	return true;
+}
+
+
+static bool unpackBoard(const PackedPosition& pp, PieceBoard& placed, Bitboard& occupied, bool& blackToMove)
+{
+	CodeBoard codes;
+	pp.toCodes(codes);
+	occupied = pp.occupied;
+	int whiteKings = 0, blackKings = 0;
+	blackToMove = false;
+	for (Bitboard b = occupied; b; )
+	{
+		const Square sq = pop_lsb(&b);
+		placed[sq] = PackedPosition::piece(codes[sq], sq);
+		whiteKings += placed[sq] == W_KING;
+		blackKings += placed[sq] == B_KING;
+		blackToMove |= codes[sq] == PackedPosition::BLACK_KING_TO_MOVE;
+	}
+	if (whiteKings != 1 || blackKings != 1 || popcount(occupied) > 32)
+		return false;
+	if (blackToMove)
+		mirrorColors(placed, occupied);
+	return true;
+}
+
+
+//revalidate FILE [--out VERDICTS] [--check-profile] [--profile P]: runs the legality checks on every position of a FEN/EPD
+//file (one per line) or a packed position file. Line n of VERDICTS is the verdict on the nth position: "legal", the rule
+//that rejected it, "profile" if it is outside the --profile restrictions (only with --check-profile) or "bad input".
+//Rule names are about the actual colors: a black-to-move position with black giving check is "white in check".
+//Blank lines aren't positions. The file is mapped and split into chunks, and the verdicts are written in input order
+void Runner::revalidate(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		cout << "Usage: ChessCounter revalidate positions.txt|positions.bin [--out verdicts.txt] [--check-profile] [--profile P]" << endl;
+		return;
+	}
+
+	LegalParams lp;
+	const int nthreads = omp_get_max_threads();
+	if (!lp.setup(argc, argv, nthreads))
+		return;
+	lp.adaptiveRuleOrder = false;			//A fixed rule order, so that the same position always gets the same verdict
+	const bool checkProfile = hasOption(argc, argv, "--check-profile");
+	const string outFile = optionValue(argc, argv, "--out", "verdicts.txt");
+
+	MappedFile text;
+	MappedPositionFile packed;
+	if (!text.open(argv[2]))
+		return;
+	const bool isPacked = text.isPositionFile();
+	if (isPacked)
+	{
+		text.close();
+		if (!packed.open(argv[2]))
+			return;
+	}
+
+	//Chunks: the blocks of a packed file, or line-aligned byte ranges of a text file
+	vector<size_t> chunkStarts = { 0 };
+	if (!isPacked)
+	{
+		const char* data = text.begin();
+		const size_t size = text.getSize();
+		while (chunkStarts.back() < size)
+		{
+			size_t next = chunkStarts.back() + TEXT_CHUNK_BYTES;
+			if (next < size)
+			{
+				const void* nl = std::memchr(data + next, '\n', size - next);
+				next = nl ? static_cast<const char*>(nl) - data + 1 : size;
+			}
+			chunkStarts.push_back(std::min(next, size));
+		}
+	}
+	const int64_t nchunks = isPacked ? int64_t(packed.getBlocks().size()) : int64_t(chunkStarts.size()) - 1;
+
+	std::ofstream out(outFile, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		cout << "Could not open " << outFile << endl;
+		return;
+	}
+
+	vector<std::array<int64_t, VERDICT_NB>> verdicts(nthreads, std::array<int64_t, VERDICT_NB>{});
+	bool corrupt = false;
+	auto start = std::chrono::steady_clock::now();
+
+#pragma omp parallel num_threads(nthreads)
+	{
+		const int tnum = omp_get_thread_num();
+		LegalChecker lc;
+		lc.init(&lp, tnum);
+		string chunkOut;								//Verdicts of the current chunk, reused
+		vector<PackedPosition> scratch;
+		PieceBoard placed;
+		Bitboard occupied;
+		bool blackToMove = false;
+		auto& counts = verdicts[tnum];
+
+		auto verdict = [&](bool parsed)
+		{
+			if (!parsed)
+				return int(VERDICT_BAD_INPUT);
+			lc.fromBoard(placed, occupied);
+			lc.createCounts();
+			lc.createTotalCounts();
+			if (!lc.checkConditions())
+				return blackToMove && lc.getRejectedBy() == RULE_BLACK_IN_CHECK ? int(VERDICT_WHITE_IN_CHECK) : int(lc.getRejectedBy());
+			if (checkProfile && !lc.checkAdditionalConditions(lp.profile))
+				return int(VERDICT_PROFILE);
+			return int(VERDICT_LEGAL);
+		};
+		auto add = [&](int v)
+		{
+			counts[v]++;
+			chunkOut += verdictName(v);
+			chunkOut += '\n';
+		};
+
+#pragma omp for schedule(dynamic, 1) ordered
+		for (int64_t c = 0; c < nchunks; c++)
+		{
+			chunkOut.clear();
+			if (isPacked)
+			{
+				const PositionBlock& block = packed.getBlocks()[c];
+				const PackedPosition* positions = packed.blockPositions(block, scratch);
+				if (!positions)
+				{
+#pragma omp atomic write
+					corrupt = true;
+				}
+				else
+					for (uint32_t q = 0; q < block.positions; q++)
+						add(verdict(unpackBoard(positions[q], placed, occupied, blackToMove)));
+			}
+			else
+			{
+				const char* p = text.begin() + chunkStarts[c];
+				const char* end = text.begin() + chunkStarts[c + 1];
+				while (p < end)
+				{
+					const char* nl = static_cast<const char*>(std::memchr(p, '\n', end - p));
+					const char* lineEnd = nl ? nl : end;
+					const char* trimmed = lineEnd;
+					while (trimmed > p && (trimmed[-1] == '\r' || trimmed[-1] == ' ' || trimmed[-1] == '\t'))
+						trimmed--;
+					if (trimmed > p)
+						add(verdict(readFenBoard(p, trimmed, placed, occupied, blackToMove)));
+					p = lineEnd + 1;
+				}
+			}
+
+#pragma omp ordered
+			out.write(chunkOut.data(), chunkOut.size());
+		}
+	}
+
+	out.close();
+	std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - start;
+	if (corrupt)
+		cout << "Corrupt blocks in " << argv[2] << ", their positions are missing from " << outFile << endl;
+	if (!out)
+		cout << "Could not write " << outFile << endl;
+
+	std::array<int64_t, VERDICT_NB> totals{};
+	int64_t positions = 0;
+	for (const auto& counts : verdicts)
+		for (int v = 0; v < VERDICT_NB; v++)
+		{
+			totals[v] += counts[v];
+			positions += counts[v];
+		}
+
+	cout << endl << "Revalidated " << positions << " positions in " << elapsedSeconds.count() << " s, "
+		<< positions / elapsedSeconds.count() << " per second with " << nthreads << " threads" << endl;
+	for (int v : { int(VERDICT_LEGAL), int(VERDICT_PROFILE), int(VERDICT_BAD_INPUT) })
+		if (v != VERDICT_PROFILE || checkProfile)
+			cout << std::setw(16) << verdictName(v) << ": " << totals[v] << endl;
+	for (int r = 0; r < RULE_NB; r++)
+	{
+		cout << std::setw(16) << RULE_NAMES[r] << ": " << totals[r] << endl;
+		if (r == RULE_BLACK_IN_CHECK)
+			cout << std::setw(16) << verdictName(VERDICT_WHITE_IN_CHECK) << ": " << totals[VERDICT_WHITE_IN_CHECK] << endl;
+	}
+	cout << "Verdicts written to " << outFile << endl;
+}
+
+
+//Sample index of the shard as posEstimate --reproducible draws it, checked with the current rules. countAs is how much it
+//adds to the legal count
+template<ESampleType sampleType>
+static int replaySample(LegalChecker& lc, const LegalParams& lp, int tnum, int64_t index, bool checkProfile, double& countAs)
+{
+	constexpr bool restrictedType = sampleType != ESampleType::PIECES_WB && sampleType != ESampleType::PIECES;
+	countAs = 0;
+	lp.beginIndexedSample(tnum, uint64_t(index));
+	if (!lc.prepare<sampleType>())
+		return VERDICT_NOT_DRAWN;
+	lc.createTotalCounts();
+	if (!lc.checkConditions())
+		return int(lc.getRejectedBy());
+	if ((restrictedType || checkProfile) && !lc.checkAdditionalConditions(lp.profile))
+		return VERDICT_PROFILE;
+	countAs = lc.getSampleWeight() * lc.countCastling() * (1 + lc.countEnPassantPossibilities());
+	return VERDICT_LEGAL;
+}
+
+
+//replay --indices A,B-C [--sample-type T] [--shard S] [--profile P] [--check-profile] [--legal-only]
+//[--out FILE]: regenerates samples of a posEstimate --reproducible run, given with the same options, from their indices
+//in the shard, and checks them with the current rules. One line per sample: index, verdict, how much it counts and the
+//FEN, tab-separated. A sample rejected in prepare has no position. Restricted sample types always check the profile
+void Runner::replay(int argc, char* argv[])
+{
+	const string indicesSpec = optionValue(argc, argv, "--indices");
+	if (indicesSpec.empty())
+	{
+		cout << "Usage: ChessCounter replay --indices 0,17,1000-1999 [--sample-type T] [--shard S] [--profile P] "
+			"[--check-profile] [--legal-only] [--out replay.txt]" << endl;
+		return;
+	}
+
+	//Chunks of at most CHUNK indices, in the order given
+	const int64_t CHUNK = 4096;
+	vector<std::pair<int64_t, int64_t>> chunks;			//First and last index, inclusive
+	std::stringstream ss(indicesSpec);
+	for (string part; std::getline(ss, part, ',');)
+	{
+		const size_t dash = part.find('-');
+		const int64_t first = std::stoll(part.substr(0, dash));
+		const int64_t last = dash == string::npos ? first : std::stoll(part.substr(dash + 1));
+		for (int64_t c = first; c <= last; c += CHUNK)
+			chunks.emplace_back(c, std::min(last, c + CHUNK - 1));
+	}
+
+	LegalParams lp;
+	const int nthreads = omp_get_max_threads();
+	if (!lp.setup(argc, argv, nthreads))
+		return;
+	lp.adaptiveRuleOrder = false;
+	const bool checkProfile = hasOption(argc, argv, "--check-profile");
+	const bool legalOnly = hasOption(argc, argv, "--legal-only");
+	const string outFile = optionValue(argc, argv, "--out", "replay.txt");
+
+	const string sampleType = optionValue(argc, argv, "--sample-type", "PIECES_WB");
+	auto replayOne = replaySample<ESampleType::PIECES_WB>;
+	if (sampleType == "PIECES")
+		replayOne = replaySample<ESampleType::PIECES>;
+	else if (sampleType == "WB_RESTRICTED")
+		replayOne = replaySample<ESampleType::WB_RESTRICTED>;
+	else if (sampleType == "RESTRICTED")
+		replayOne = replaySample<ESampleType::RESTRICTED>;
+	else if (sampleType == "VERY_RESTRICTED")
+		replayOne = replaySample<ESampleType::VERY_RESTRICTED>;
+
+	std::ofstream out(outFile, std::ios::binary | std::ios::trunc);
+	if (!out)
+	{
+		cout << "Could not open " << outFile << endl;
+		return;
+	}
+
+	vector<std::array<int64_t, VERDICT_NB>> verdicts(nthreads, std::array<int64_t, VERDICT_NB>{});
+	vector<double> legal(nthreads, 0);
+
+#pragma omp parallel num_threads(nthreads)
+	{
+		const int tnum = omp_get_thread_num();
+		LegalChecker lc;
+		lc.init(&lp, tnum);
+		std::ostringstream chunkOut;
+		chunkOut.precision(17);
+
+#pragma omp for schedule(dynamic, 1) ordered
+		for (int64_t c = 0; c < int64_t(chunks.size()); c++)
+		{
+			chunkOut.str("");
+			for (int64_t index = chunks[c].first; index <= chunks[c].second; index++)
+			{
+				double countAs = 0;
+				const int v = replayOne(lc, lp, tnum, index, checkProfile, countAs);
+				verdicts[tnum][v]++;
+				legal[tnum] += countAs;
+				if (legalOnly && v != VERDICT_LEGAL)
+					continue;
+				chunkOut << index << '\t' << verdictName(v) << '\t' << countAs << '\t' << (v == VERDICT_NOT_DRAWN ? "" : lc.fen()) << '\n';
+			}
+
+#pragma omp ordered
+			out << chunkOut.str();
+		}
+	}
+
+	out.close();
+	if (!out)
+		cout << "Could not write " << outFile << endl;
+
+	std::array<int64_t, VERDICT_NB> totals{};
+	int64_t samples = 0;
+	double totalLegal = 0;
+	for (int t = 0; t < nthreads; t++)
+	{
+		for (int v = 0; v < VERDICT_NB; v++)
+		{
+			totals[v] += verdicts[t][v];
+			samples += verdicts[t][v];
+		}
+		totalLegal += legal[t];
+	}
+
+	cout << endl << "Replayed " << samples << " " << sampleType << " samples of shard " << lp.shard << ", legal count " << totalLegal << endl;
+	for (int v : { int(VERDICT_LEGAL), int(VERDICT_PROFILE), int(VERDICT_NOT_DRAWN) })
+		cout << std::setw(20) << verdictName(v) << ": " << totals[v] << endl;
+	for (int r = 0; r < RULE_NB; r++)
+		cout << std::setw(20) << RULE_NAMES[r] << ": " << totals[r] << endl;
+	cout << "Written to " << outFile << endl;
+}
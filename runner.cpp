@@ -1,11 +1,20 @@
 #include "runner.h"
 #include "LegalChecker.h"
 #include "LegalParams.h"
+#include "Checkpoint.h"
+#include "Counts.h"
+#include "EstimateStats.h"
+#include "MateSolver.h"
+#include "Options.h"
+#include "PositionFile.h"
 #include <omp.h>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <fstream>
+#include <iomanip>
 #include <string>
+#include <thread>
 
 using std::vector;
 using std::cout;
@@ -19,16 +28,6 @@ void init();
 
 
 
-void Runner::saveFile(string fname, const vector<string>& v)
-{
-	std::ofstream f(fname);
-	for (vector<string>::const_iterator i = v.begin(); i != v.end(); ++i) 
-	{
-		f << *i << '\n';
-	}
-}
-
-
 void Runner::init()
 {
 	cout << engine_info() << endl;
@@ -69,6 +68,27 @@ template<typename TEl>
 }
 
 
+//Rejections and cost of each checkConditions rule over all threads, in the order thread 0 runs them
+static void printRuleStats(const LegalParams& lp, int nthreads)
+{
+	RuleStats total;
+	for (int t = 0; t < nthreads; t++)
+		total += lp.ruleStats[t];
+
+	cout << "Rules" << (lp.adaptiveRuleOrder ? " (adaptive order)" : "") << ":  board setup " << std::fixed << std::setprecision(1)
+		<< (total.boardTimed.get() ? double(total.boardCycles.get()) / total.boardTimed.get() : 0) << " cycles" << endl;
+	for (const auto& ruleInOrder : lp.ruleStats[0].order)
+	{
+		const ERule rule = ruleInOrder.get();
+		cout << "  " << std::setw(16) << RULE_NAMES[rule] << "  checked: " << std::setw(12) << total.checked[rule].get()
+			<< "  rejected: " << std::setprecision(2) << std::setw(6) << 100.0 * total.rejected[rule].get() / std::max<int64_t>(1, total.checked[rule].get()) << "%"
+			<< std::setprecision(1)
+			<< "  cycles: " << std::setw(7) << total.cyclesPerCheck(rule) << endl;
+	}
+	cout << std::defaultfloat << std::setprecision(6);
+}
+
+
 bool checkFromFen(const string& fen, LegalParams& lp, bool restricted)
 {
 	LegalChecker lc;
@@ -78,7 +98,7 @@ bool checkFromFen(const string& fen, LegalParams& lp, bool restricted)
 	lc.createTotalCounts();
 	bool isok = lc.checkConditions();
 	if (isok && restricted)
-		isok = lc.checkAdditionalConditions(false, 3, 6);
+		isok = lc.checkAdditionalConditions(PROFILE_RESTRICTED);
 	cout << fen << "  result = " << isok << endl;
 	return isok;
 }
@@ -137,67 +157,233 @@ void validate(LegalParams& lp)
 }
 
 
-void Runner::generateFens(int argc, char* argv[], string fname)
+//generate-fens --out FILE [--positions N] [--format fen|packed] [--zstd]: legal positions within the restriction profile,
+//streamed to FILE as they are found
+void Runner::generateFens(int argc, char* argv[])
 {
 	LegalParams lp;
 
-	//const int nthreads = std::max(1, omp_get_max_threads() - 1);
-	const int nthreads = 20;
-	lp.setup(argc, argv, nthreads);
-	const ESampleType sampleType = ESampleType::VERY_RESTRICTED;
-	const int64_t RUNS = 1'000'000'000'000'000;
-
-	vector<vector<string>> mates(nthreads);
-	for (auto& m : mates)
-		m.reserve(30'000'000);
+	const int nthreads = std::max(1, omp_get_max_threads() - 1);
+	if (!lp.setup(argc, argv, nthreads))
+		return;
+	const string fname = optionValue(argc, argv, "--out", "positions.txt");
+	const int64_t wanted = std::stoll(optionValue(argc, argv, "--positions", "1000000"));
+	const string formatName = optionValue(argc, argv, "--format", "fen");
+	if (formatName != "fen" && formatName != "packed")
+	{
+		cout << "--format is fen or packed" << endl;
+		return;
+	}
+	const EPositionFormat format = formatName == "packed" ? EPositionFormat::PACKED : EPositionFormat::FEN;
+	PositionWriter writer(fname, format, hasOption(argc, argv, "--zstd"), nthreads);
+	if (!writer.isOpen())
+		return;
 
-	int64_t added = 0;
+	std::atomic<int64_t> added = 0;
+	const int64_t REPORT_EVERY = 2048 * 1024;
 	auto start = std::chrono::steady_clock::now();
 
-
-#pragma omp parallel for num_threads(nthreads)
-	for (int64_t x = 0; x < RUNS; x++)
+#pragma omp parallel num_threads(nthreads)
 	{
-		int tnum = omp_get_thread_num();
+		const int tnum = omp_get_thread_num();
 		LegalChecker lc;
 		lc.init(&lp, tnum);
-		bool cont = lc.prepareMateVarious();
-		if (cont)
+		while (added.load(std::memory_order_relaxed) < wanted)
 		{
+			if (!lc.prepareMateVarious())
+				continue;
 			lc.createTotalCounts();
-			bool isok = lc.checkConditions();
-
-			if (isok)
+			if (!lc.checkConditions() || !lc.checkAdditionalConditions(lp.profile))
+				continue;
+
+			const int64_t n = added.fetch_add(1, std::memory_order_relaxed) + 1;
+			if (n > wanted)
+				break;
+			writer.add(tnum, lc.position());
+			if (n % REPORT_EVERY == 0)
 			{
-				bool isokRestricted = lc.checkAdditionalConditions(false, 3, 6);
-				if (isokRestricted || sampleType == ESampleType::PIECES_WB || sampleType == ESampleType::PIECES)
-				{
-					auto& matesOneVec = mates[tnum];
-					matesOneVec.emplace_back(lc.fen());
-#pragma omp atomic
-					added++;
-					if (added % (2048*1024) == 1)
-					{
+				std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - start;
 #pragma omp critical
-						{
-							std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - start;
-							cout << "Speed: " << added / elapsedSeconds.count() << endl;
-
-							vector<string> all;
-							all.reserve(added);
-							for (int t=0; t<nthreads; t++)
-							{
-								for (int64_t q = 0; q < (int64_t)mates[t].size(); q++)
-									all.emplace_back(mates[t][q]);
-							}
-							saveFile(fname, all);
-							cout << added << endl;
-						}
-					}
-				}
+				cout << n << " positions, " << n / elapsedSeconds.count() << " per second" << endl;
 			}
 		}
 	}
+
+	writer.close();
+	std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - start;
+	cout << "Wrote " << writer.getPositionsWritten() << " positions, " << writer.getBytesWritten() << " bytes to " << fname << " in "
+		<< elapsedSeconds.count() << " s" << endl;
+}
+
+
+//positions-to-fen FILE [--out FENFILE]: a packed position file as FENs, one per line, to FENFILE or the console
+void Runner::positionsToFen(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		cout << "Usage: ChessCounter positions-to-fen positions.bin [--out positions.txt]" << endl;
+		return;
+	}
+	const string outFile = optionValue(argc, argv, "--out");
+	std::ofstream out;
+	if (!outFile.empty())
+		out.open(outFile, std::ios::trunc);
+	std::ostream& os = outFile.empty() ? cout : out;
+
+	int64_t n = 0;
+	const bool ok = readPositionFile(argv[2], [&](const PackedPosition* positions, size_t count)
+	{
+		for (size_t q = 0; q < count; q++)
+			os << positions[q].fen() << '\n';
+		n += count;
+	});
+	if (ok && !outFile.empty())
+		cout << "Wrote " << n << " positions to " << outFile << endl;
+}
+
+
+//mate-search FILE --moves N [--out MATES] [--tt-mb MB] [--root-split]: the positions of a FEN/EPD or packed file in which
+//the side to move mates in at most N moves, to MATES in input order. Positions are shared out dynamically over the threads,
+//one solver each. With few positions, or --root-split, every position is split over the threads at the root instead.
+//Lines that aren't positions the solver can take are skipped and counted
+void Runner::mateSearch(int argc, char* argv[])
+{
+	if (argc < 3)
+	{
+		cout << "Usage: ChessCounter mate-search positions.txt|positions.bin --moves N [--out mates.txt] [--tt-mb 64] [--root-split]" << endl;
+		return;
+	}
+	const int moves = std::stoi(optionValue(argc, argv, "--moves", "3"));
+	const string outFile = optionValue(argc, argv, "--out", "mates.txt");
+	const size_t ttMegabytes = std::stoull(optionValue(argc, argv, "--tt-mb", "64"));
+	const int nthreads = omp_get_max_threads();
+	LegalParams lp;
+	lp.setupSF(argc, argv);
+
+	vector<string> fens;
+	if (!readFens(argv[2], fens))
+		return;
+	size_t searchable = 0;
+	for (auto& fen : fens)
+		if (searchableFen(fen))
+			fens[searchable++] = std::move(fen);
+	if (searchable < fens.size())
+		cout << "Skipped " << fens.size() - searchable << " lines that aren't valid positions" << endl;
+	fens.resize(searchable);
+	const int64_t npositions = int64_t(fens.size());
+	const bool rootSplit = hasOption(argc, argv, "--root-split") || npositions < 4 * nthreads;
+
+	vector<char> isMate(npositions, 0);
+	uint64_t nodes = 0;
+	auto start = std::chrono::steady_clock::now();
+	if (rootSplit)
+	{
+		vector<MateSolver> solvers;
+		for (int t = 0; t < nthreads; t++)
+			solvers.emplace_back(ttMegabytes);
+		for (int64_t x = 0; x < npositions; x++)
+			isMate[x] = isMateRootSplit(fens[x], moves, solvers);
+		for (const auto& solver : solvers)
+			nodes += solver.getNodes();
+	}
+	else
+	{
+#pragma omp parallel num_threads(nthreads) reduction(+:nodes)
+		{
+			MateSolver solver(ttMegabytes);
+			StateInfo st;
+			Position pos;
+#pragma omp for schedule(dynamic, 16)
+			for (int64_t x = 0; x < npositions; x++)
+			{
+				pos.set(fens[x], false, &st, Threads.main());
+				isMate[x] = solver.isMate(pos, moves);
+			}
+			nodes += solver.getNodes();
+		}
+	}
+	std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - start;
+
+	std::ofstream out(outFile, std::ios::trunc);
+	int64_t mates = 0;
+	for (int64_t x = 0; x < npositions; x++)
+		if (isMate[x])
+		{
+			out << fens[x] << '\n';
+			mates++;
+		}
+	if (!out)
+		cout << "Could not write " << outFile << endl;
+
+	cout << "Mate in " << moves << " or less: " << mates << " of " << npositions << " positions, written to " << outFile << endl;
+	cout << elapsedSeconds.count() << " s, " << npositions / elapsedSeconds.count() << " positions/s, " << nodes / elapsedSeconds.count()
+		<< " nodes/s with " << nthreads << " threads" << (rootSplit ? ", split at the root" : "") << endl;
+}
+
+
+//One posEstimate sample on lc, counted into st. With --stratified, stratum is the one it is drawn from and stratumMult
+//its W_h / p_h, otherwise -1 and 1. bench-counter runs it too, to check that the steady state doesn't allocate
+template<ESampleType sampleType>
+void Runner::countSample(LegalChecker& lc, const LegalParams& lp, EstimateStats& st, int stratum, double stratumMult) const
+{
+	st.all.add(1);
+	if (!lc.prepare<sampleType>())
+		return;
+	lc.createTotalCounts();
+	if (!lc.checkConditions())
+		return;
+
+	const double w = lc.getSampleWeight() * stratumMult;
+	auto [wk, bk] = lc.getKings();
+	st.kingSquares[wk].add(w);
+	st.kingSquares[bk].add(w);
+	st.kingIn[lc.getKingInPawnSquares()].add(w);
+
+	for (Piece p = W_PAWN; p <= B_KING; ++p)
+		st.pieceCounts[p][lc.getCount()[p]].add(w);
+
+	int castlingMult = lc.countCastling();		//If there are castling possibilities, this position counts as multiple (2^castling_possibilties)
+	int epPoss = lc.countEnPassantPossibilities();		//En passant possibilities
+
+	const double countAs = w * castlingMult * (1 + epPoss);
+	st.legalHits.add(1);
+	st.legal.add(countAs);
+	st.legalSq.add(countAs * countAs);
+	st.byCount[lc.totalPieces()].add(countAs);
+	st.byCountSq[lc.totalPieces()].add(countAs * countAs);
+
+	for (size_t c = 0; c < openingsToCheck.size(); c++)
+	{
+		if (lc.checkOpening(openingsToCheck[c]))
+		{
+			st.openings[c].add(w);
+			st.openingsSq[c].add(w * w);
+		}
+	}
+
+	bool isokRestricted = lc.checkAdditionalConditions(lp.profile);
+	if (isokRestricted)
+	{
+		st.legalRestricted.add(countAs);
+		st.legalRestrictedSq.add(countAs * countAs);
+		st.byCountRestricted[lc.totalPieces()].add(countAs);
+		st.byCountRestrictedSq[lc.totalPieces()].add(countAs * countAs);
+		if (stratum >= 0)
+		{
+			const double value = countAs / stratumMult;
+			st.stratumSum[stratum].add(value);
+			st.stratumSumSq[stratum].add(value * value);
+		}
+	}
+
+	for (size_t q = 0; q < lp.extraProfiles.size(); q++)
+	{
+		if (lc.checkAdditionalConditions(lp.extraProfiles[q]))
+		{
+			st.profiles[q].add(countAs);
+			st.profilesSq[q].add(countAs * countAs);
+		}
+	}
 }
 
 
@@ -207,192 +393,417 @@ void Runner::posEstimate(int argc, char* argv[])
 	LegalParams lp;
 
 	const int nthreads = std::max(1, omp_get_max_threads() - 1);
-	lp.setup(argc, argv, nthreads);
+	if (!lp.setup(argc, argv, nthreads))
+		return;
 
-	const int64_t RUNS = 1'000'000'000'000'000;
+	const int64_t RUNS = std::stoll(optionValue(argc, argv, "--samples", "1000000000000000000"));
 	cout << endl << "Running ";
 	if (sampleType == ESampleType::PIECES)
 		cout << "PIECES: estimating legal positions from a general case. Slow, used to validate PIECES_WB " << endl;
 	else if (sampleType == ESampleType::PIECES_WB)
 		cout << "PIECES_WB: estimating legal positions when white and black pieces are chosen separately " << endl;
 	else if (sampleType == ESampleType::WB_RESTRICTED)
-		cout << "WB_RESTRICTED: estimating legal positions without underpromotions and with at most 3 queens per side from the search space with white and black pieces chosen separately. Slow, used to validate RESTRICTED" << endl;
+		cout << "WB_RESTRICTED: estimating legal positions " << lp.profile.describe() << " from the search space with white and black pieces chosen separately. Slow, used to validate RESTRICTED" << endl;
 	else if (sampleType == ESampleType::RESTRICTED)
-		cout << "RESTRICTED: estimating legal positions without underpromotions and with at most 3 queens per side" << endl;
+		cout << "RESTRICTED: estimating legal positions " << lp.profile.describe() << endl;
 	else if (sampleType == ESampleType::VERY_RESTRICTED)
-		cout << "VERY_RESTRICTED: estimating legal positions without underpromotions and with at most 1 queen per side" << endl;
+		cout << "VERY_RESTRICTED: estimating legal positions " << lp.profile.describe() << endl;
 
 		const double totalPossibilities = (sampleType == ESampleType::PIECES ? lp.combsSum :
 			(sampleType == ESampleType::PIECES_WB || sampleType == ESampleType::WB_RESTRICTED) ? lp.combsSumWB : 
-			(sampleType == ESampleType::RESTRICTED ? lp.combsSumRestricted : lp.combsSumVeryRestricted)) * 2.0 * lp.KING_COMBINATIONS;	//* 2 because WTM and BTM
-
-	vector<int64_t> legal(nthreads, 0), legalRestricted(nthreads, 0), all(nthreads, 0);
-	vector<vector<int64_t>> byCount(nthreads), byCountRestricted(nthreads);
-	vector<vector<int64_t>> legalOpeningsCount(openingsToCheck.size());
-	for (auto& lo : legalOpeningsCount)
-		lo.resize(nthreads, 0);
-	for (auto& b : byCount)
-		b.resize(33, 0);
-	for (auto& b : byCountRestricted)
-		b.resize(33, 0);
-
-	vector<vector<int64_t>> kingSquares(64);
-	for (auto& k : kingSquares)
-		k.resize(nthreads, 0);
+			lp.combsSumRestricted) * 2.0 * lp.KING_COMBINATIONS;	//* 2 because WTM and BTM
 
-	validate(lp);
+	//--profiles: every legal sample is also checked against these. Legality is the expensive part, so each one costs
+	//little more than a counter. A restricted sample type only draws positions within its own profile, so that is all
+	//another profile can be counted over
+	const bool restrictedType = sampleType != ESampleType::PIECES_WB && sampleType != ESampleType::PIECES;
+	for (const auto& rp : lp.extraProfiles)
+	{
+		cout << "Also counting positions " << rp.describe() << endl;
+		if (restrictedType && !rp.caps.within(lp.profile.caps))
+			cout << "  Warning: " << rp.name() << " is not within " << lp.profile.name() << ", only its positions within " << lp.profile.name() << " are counted" << endl;
+	}
+
+	//--stratified: RESTRICTED and VERY_RESTRICTED draw the number of pieces by Neyman allocation instead of in proportion
+	//to the search space. Every sample is weighted by W_h / p_h, so all the other counters stay unbiased
+	const Strata* strata = nullptr;
+	if (lp.stratified && lp.reproducible)
+		cout << "--stratified is ignored with --reproducible" << endl;
+	else if (lp.stratified && (sampleType == ESampleType::RESTRICTED || sampleType == ESampleType::VERY_RESTRICTED))
+		strata = &lp.strataRestricted;
+	else if (lp.stratified)
+		cout << "--stratified only applies to RESTRICTED and VERY_RESTRICTED, ignored" << endl;
+	const int64_t REALLOCATE_EVERY = 1 << 16;		//Samples of a thread between updates of its allocation
+
+	//--reproducible: thread t draws the samples t, t + nthreads, t + 2 * nthreads... of the shard, each from a Philox
+	//stream of its index. A run of --samples N draws the same N samples with any number of threads, and replay
+	//regenerates any of them. The adaptive allocation above learns from each thread's own samples, so it can't be used
+	if (lp.reproducible)
+		cout << "Every sample is drawn from the stream of its index" << endl;
+
+	//--numa: every thread is pinned to a CPU of its node and samples from that node's memory: its own copy of the sampling
+	//tables, its random streams, SF states, rule telemetry and counters. Reports add the throughput of every node
+	const bool numa = hasOption(argc, argv, "--numa");
+	if (numa)
+	{
+		lp.setupNuma(nthreads);
+		for (int node = 0; node < lp.numa.nodes(); node++)
+			cout << "NUMA " << lp.numa.describe(node) << endl;
+	}
+	std::atomic<bool> placementFailed = false;
 
-	vector<vector<vector<int64_t>>> pieceCountsByThread(nthreads);
-	for (auto& pc : pieceCountsByThread)
+	//Legal counts are weighted by how much each sample counts (castling, en passant, pawn placement probability)
+	if (openingsToCheck.size() > EstimateStats::MAX_OPENINGS || lp.extraProfiles.size() > EstimateStats::MAX_PROFILES)
 	{
-		pc.resize(int(PIECE_NB));
-		for (auto& p : pc)
-			p.resize(16, 0);
+		cout << "At most " << EstimateStats::MAX_OPENINGS << " openings and " << EstimateStats::MAX_PROFILES << " --profiles can be counted" << endl;
+		return;
 	}
+	vector<EstimateStats> stats(nthreads);
+	for (auto& st : stats)
+		st.setSizes(openingsToCheck.size(), lp.extraProfiles.size());
 
-	vector<vector<int64_t>> kingIn(3);
-	for (auto& k : kingIn)
-		k.resize(nthreads, 0);
+	validate(lp);
+
+	//--checkpoint file: save all counters and random states every --checkpoint-minutes. --resume: continue from that file
+	const string checkpointFile = optionValue(argc, argv, "--checkpoint");
+	const double checkpointSeconds = 60 * std::stod(optionValue(argc, argv, "--checkpoint-minutes", "5"));
+	Checkpoint checkpoint(nthreads, openingsToCheck.size(), lp.extraProfiles.size());
+	if (hasOption(argc, argv, "--resume"))
+	{
+		if (checkpointFile.empty() || !Checkpoint::load(checkpointFile, sampleType, strata != nullptr, stats, lp))
+		{
+			cout << "Cannot resume, use --checkpoint with the file of the previous run" << endl;
+			return;
+		}
+		cout << "Resumed from " << checkpointFile << endl;
+	}
 
+	double resumedSamples = 0;
+	vector<double> resumedByThread;
+	for (const auto& st : stats)
+	{
+		resumedSamples += st.all.get();
+		resumedByThread.push_back(double(st.all.get()));
+	}
 	auto start = std::chrono::steady_clock::now();
-	vector<vector<string>> mates(33);
-	for (auto& m : mates)
-		m.reserve(1'000'000);
-	const bool SAVE_MATES = true;
 
-#pragma omp parallel for num_threads(nthreads)
-	for (int64_t x = 0; x < RUNS; x++)
+	auto sum = [&](auto&& counter)
 	{
-		int tnum = omp_get_thread_num();
-		all[tnum]++;
-		LegalChecker lc;
-		lc.init(&lp, tnum);
-		bool cont = lc.prepare<sampleType>();
-		if (cont)
+		double s = 0;
+		for (const auto& st : stats)
+			s += counter(st).get();
+		return s;
+	};
+
+	//Totals over all threads, with what the standard errors need
+	auto makeCounts = [&]()
+	{
+		EstimateCounts ec;
+		ec.sampleType = SAMPLE_TYPE_NAMES[int(sampleType)];
+		ec.profile = lp.profile.name();
+		ec.shard = lp.shard;
+		ec.shards = lp.shards;
+		ec.samples = int64_t(sum([](const EstimateStats& st) -> auto& { return st.all; }));
+		ec.legalHits = int64_t(sum([](const EstimateStats& st) -> auto& { return st.legalHits; }));
+		ec.totalPossibilities = totalPossibilities;
+		ec.legal = sum([](const EstimateStats& st) -> auto& { return st.legal; });
+		ec.legalSq = sum([](const EstimateStats& st) -> auto& { return st.legalSq; });
+		ec.legalRestricted = sum([](const EstimateStats& st) -> auto& { return st.legalRestricted; });
+		ec.legalRestrictedSq = sum([](const EstimateStats& st) -> auto& { return st.legalRestrictedSq; });
+		for (int q = 0; q < int(ec.byCount.size()); q++)
 		{
-			lc.createTotalCounts();
-			bool isok = lc.checkConditions();
+			ec.byCount[q] = sum([q](const EstimateStats& st) -> auto& { return st.byCount[q]; });
+			ec.byCountRestricted[q] = sum([q](const EstimateStats& st) -> auto& { return st.byCountRestricted[q]; });
+			ec.byCountSq[q] = sum([q](const EstimateStats& st) -> auto& { return st.byCountSq[q]; });
+			ec.byCountRestrictedSq[q] = sum([q](const EstimateStats& st) -> auto& { return st.byCountRestrictedSq[q]; });
+		}
+		for (size_t c = 0; c < openingsToCheck.size(); c++)
+		{
+			ec.openingNames.push_back(openingsToCheck[c].name);
+			ec.openings.push_back(sum([c](const EstimateStats& st) -> auto& { return st.openings[c]; }));
+			ec.openingsSq.push_back(sum([c](const EstimateStats& st) -> auto& { return st.openingsSq[c]; }));
+		}
+		for (size_t c = 0; c < lp.extraProfiles.size(); c++)
+		{
+			ec.profileNames.push_back(lp.extraProfiles[c].name());
+			ec.profiles.push_back(sum([c](const EstimateStats& st) -> auto& { return st.profiles[c]; }));
+			ec.profilesSq.push_back(sum([c](const EstimateStats& st) -> auto& { return st.profilesSq[c]; }));
+		}
+		return ec;
+	};
+
+	auto strataTotals = [&](auto&& forStats)
+	{
+		StrataTotals t;
+		for (const auto& st : stats)
+		{
+			if (!forStats(st))
+				continue;
+			for (int h = 0; h < NUM_STRATA; h++)
+			{
+				t.samples[h] += st.stratumSamples[h].get();
+				t.sum[h] += st.stratumSum[h].get();
+				t.sumSq[h] += st.stratumSumSq[h].get();
+				t.cycles[h] += st.stratumCycles[h].get();
+			}
+		}
+		return t;
+	};
+	auto allThreads = [](const EstimateStats&) { return true; };
+
+	//Standard error of the main estimate of this sample type. Stratified: the sum of the stratum means times their weights
+	auto mainEstimate = [&](const EstimateCounts& ec)
+	{
+		if (strata)
+		{
+			const auto [est, se] = strata->estimate(strataTotals(allThreads));
+			return std::make_pair(est * totalPossibilities, se * totalPossibilities);
+		}
+		return restrictedType ? ec.estimate(ec.legalRestricted, ec.legalRestrictedSq) : ec.estimate(ec.legal, ec.legalSq);
+	};
+
+	//--counts file: totals of this shard for the merge subcommand, rewritten with every report
+	const string countsFile = optionValue(argc, argv, "--counts");
+
+	//Runs on the reporter thread. Reads the workers' counters while they keep updating them
+	auto report = [&]()
+	{
+		const EstimateCounts ec = makeCounts();
+		const double totalGood = ec.legal;
+		const double totalGoodRestricted = ec.legalRestricted;
+		const double totalAny = double(ec.samples);
+		if (totalAny == 0)
+			return;
+		std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - start;
+		cout << "Per second: " << (totalAny - resumedSamples) / elapsedSeconds.count();
+
+		if (sampleType == ESampleType::VERY_RESTRICTED)
+			cout << "  legal_very_restricted: " << totalGoodRestricted << " / all: " << int64_t(totalAny) << "  estimate restricted: "
+			<< formatEstimate(mainEstimate(ec)) << endl;
+
+		if (sampleType == ESampleType::RESTRICTED || sampleType == ESampleType::WB_RESTRICTED)
+			cout << "  legal_restricted: " << totalGoodRestricted << " / all: " << int64_t(totalAny) << "  estimate restricted: "
+			<< formatEstimate(mainEstimate(ec)) << endl;
+
+		if (sampleType == ESampleType::PIECES_WB || sampleType == ESampleType::PIECES)
+			cout << "  legal: " << totalGood << " / all: " << int64_t(totalAny) << "  fraction legal: "
+			<< totalGood / totalAny << "  estimate all: " << formatEstimate(mainEstimate(ec)) << endl;
+		for (int node = 0; node < (numa ? lp.numa.nodes() : 0); node++)
+		{
+			double samples = 0;
+			int threads = 0;
+			for (int t = 0; t < nthreads; t++)
+			{
+				if (lp.numa.threadNode[t] != node)
+					continue;
+				samples += stats[t].all.get() - resumedByThread[t];
+				threads++;
+			}
+			cout << "  NUMA " << lp.numa.describe(node) << ": " << samples / elapsedSeconds.count() << " samples/s";
+			if (threads)
+				cout << "  per thread: " << samples / elapsedSeconds.count() / threads;
+			cout << endl;
+		}
+		if (placementFailed)
+			cout << "  Warning: not every thread could be pinned or have its memory moved to its node" << endl;
+		printRuleStats(lp, nthreads);
 
-			if (isok)
+		if (strata)
+		{
+			const StrataTotals t = strataTotals(allThreads);
+			cout << "Strata: share of the search space / share of the samples / estimate" << endl;
+			for (int h = 0; h < NUM_STRATA; h++)
 			{
-				auto [wk, bk] = lc.getKings();
-				kingSquares[(int)wk][tnum]++;
-				kingSquares[(int)bk][tnum]++;
-				kingIn[lc.getKingInPawnSquares()][tnum]++;
+				const auto [est, se] = strata->stratumEstimate(t, h);
+				cout << std::setw(3) << h + 2 << " pieces:  " << std::setw(12) << strata->weight(h) << "  " << std::setw(12) << t.samples[h] / totalAny
+					<< "  " << formatEstimate({ est * totalPossibilities, se * totalPossibilities }) << endl;
+			}
+		}
 
-				for (Piece p = W_PAWN; p <= B_KING; ++p)
-					pieceCountsByThread[tnum][(int)p][lc.getCount()[p]]++;
+		cout << "king squares ";
+		for (int q = 0; q < 64; q++)
+			cout << sum([q](const EstimateStats& st) -> auto& { return st.kingSquares[q]; }) << " ";
+		cout << endl;
+		for (int q = 2; q <= 32; q++)
+		{
+			cout << q << " pieces:   ";
+
+			if (sampleType == ESampleType::PIECES_WB || sampleType == ESampleType::PIECES)
+				cout << "legal = " << ec.byCount[q] << "  estimate = " << formatEstimate(ec.estimate(ec.byCount[q], ec.byCountSq[q])) << endl;
+			else if (sampleType == ESampleType::RESTRICTED)
+				cout << "legal restricted = " << ec.byCountRestricted[q] << "  estimate = " << formatEstimate(ec.estimate(ec.byCountRestricted[q], ec.byCountRestrictedSq[q])) << endl;
+			else
+				cout << "legal very restricted = " << ec.byCountRestricted[q] << "  estimate = " << formatEstimate(ec.estimate(ec.byCountRestricted[q], ec.byCountRestrictedSq[q])) << endl;
+		}
 
-				int countAs = lc.countCastling();		//If there are castling possibilities, this position counts as multiple (2^castling_possibilties)
-				int epPoss = lc.countEnPassantPossibilities();		//En passant possibilities
+		for (Piece p = W_PAWN; p <= B_KING; ++p)
+		{
+			string s = color_of(p) ? "White " : "Black ";
+			auto pt = type_of(p);
+			if (pt == PAWN || pt == BISHOP || pt == KNIGHT || pt == ROOK || pt == QUEEN)
+			{
+				if (pt == PAWN)
+					s += "pawn";
+				else if (pt == BISHOP)
+					s += "bishop";
+				else if (pt == KNIGHT)
+					s += "knight";
+				else if (pt == ROOK)
+					s += "rook";
+				else if (pt == QUEEN)
+					s += "queen";
+				s += "   ";
+				for (int q = 0; q < 16; q++)
+					s += std::to_string(int64_t(sum([p, q](const EstimateStats& st) -> auto& { return st.pieceCounts[p][q]; }))) + " ";
+				cout << s << endl;
+			}
+		}
 
-				countAs *= (1 + epPoss);
-				legal[tnum] += countAs;
-				byCount[tnum][lc.totalPieces()] += countAs;
+		for (size_t c = 0; c < ec.openings.size(); c++)
+			cout << ec.openingNames[c] << ":  legal = " << ec.openings[c] << "  estimate = " << formatEstimate(ec.estimate(ec.openings[c], ec.openingsSq[c])) << endl;
+		for (size_t c = 0; c < ec.profiles.size(); c++)
+			cout << "Profile " << ec.profileNames[c] << ":  legal = " << ec.profiles[c] << "  estimate = " << formatEstimate(ec.estimate(ec.profiles[c], ec.profilesSq[c])) << endl;
 
-				int c = 0;
-				for (const auto& open : openingsToCheck)
-				{
-					auto allowOpening = lc.checkOpening(open);
-					if (allowOpening)
-						legalOpeningsCount[c][tnum]++;
-					c++;
-				}
+		if (!countsFile.empty())
+			(void)ec.save(countsFile);
+	};
+
+	//The workers never print or wait for the reporter
+	const double reportSeconds = std::stod(optionValue(argc, argv, "--report-seconds", "10"));
+	std::atomic<bool> done = false;
 
-				bool isokRestricted = lc.checkAdditionalConditions(false, 3, 6);
-				if (isokRestricted)
+	//--target-rel-error r: stop once the standard error of the main estimate is below r times the estimate.
+	//Not before there are enough legal samples for the standard error itself to be reliable
+	const double targetRelError = std::stod(optionValue(argc, argv, "--target-rel-error", "0"));
+	const int64_t MIN_HITS_FOR_STOP = 100;
+	std::atomic<bool> stop = false;
+	auto targetReached = [&]()
+	{
+		const EstimateCounts ec = makeCounts();
+		const auto [est, se] = mainEstimate(ec);
+		return ec.legalHits >= MIN_HITS_FOR_STOP && est > 0 && se <= targetRelError * est;
+	};
+
+	auto reportLoop = [&]()
+	{
+		auto lastReport = std::chrono::steady_clock::now();
+		auto lastCheckpoint = lastReport;
+		auto lastStopCheck = lastReport;
+		while (!done)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (targetRelError > 0 && !stop && std::chrono::steady_clock::now() - lastStopCheck >= std::chrono::seconds(1))
+			{
+				lastStopCheck = std::chrono::steady_clock::now();
+				if (targetReached())
 				{
-					legalRestricted[tnum] += countAs;
-					byCountRestricted[tnum][lc.totalPieces()] += countAs;
+					cout << "Target relative error " << targetRelError << " reached" << endl;
+					stop = true;
 				}
 			}
+			if (std::chrono::steady_clock::now() - lastReport >= std::chrono::duration<double>(reportSeconds))
+			{
+				report();
+				lastReport = std::chrono::steady_clock::now();
+			}
+			if (!checkpointFile.empty() && std::chrono::steady_clock::now() - lastCheckpoint >= std::chrono::duration<double>(checkpointSeconds))
+			{
+				if (checkpoint.collect(done) && checkpoint.save(checkpointFile, sampleType, lp.profilesName(), lp.shard, lp.reproducible, strata != nullptr))
+					cout << "Checkpoint saved to " << checkpointFile << endl;
+				lastCheckpoint = std::chrono::steady_clock::now();
+			}
+		}
+	};
+	std::thread reporter;
 
-			if (all[tnum] % (2048 * 1024) == (2048 * 1024 * tnum / nthreads))
+	//Each thread draws a fixed share of the samples from its own random stream (or of the sample indices with
+	//--reproducible), so a resumed run continues exactly
+#pragma omp parallel num_threads(nthreads)
+	{
+		const int tnum = omp_get_thread_num();
+		const int64_t threadRuns = RUNS / nthreads + (tnum < RUNS % nthreads ? 1 : 0);
+		EstimateStats& st = stats[tnum];
+		if (numa)
+		{
+			if (!lp.placeThread(tnum) || !lp.numa.moveToNode(&st, sizeof(st), lp.numa.threadNode[tnum]))
+				placementFailed = true;
+		}
+		//Placing a thread frees the buffers the reporter reads, so it only starts once every thread is placed
+#pragma omp barrier
+#pragma omp master
+		reporter = std::thread(reportLoop);
+
+		//--stratified: the allocation is recomputed from this thread's own counters every REALLOCATE_EVERY samples,
+		//and saved with them, so that a resumed run draws the same strata
+		AliasTable strataPick;
+		auto rebuildStrataPick = [&]()
+		{
+			//Counters that have never sampled with strata have no allocation yet, start from the proportional one
+			double allocSum = 0;
+			for (int h = 0; h < NUM_STRATA; h++)
+				allocSum += st.stratumAlloc[h].get();
+			if (allocSum <= 0)
 			{
-#pragma omp critical
+				const auto proportional = strata->allocation(StrataTotals{}, 0);
+				for (int h = 0; h < NUM_STRATA; h++)
+					st.stratumAlloc[h].set(proportional[h]);
+			}
+			vector<OneComb> alloc(NUM_STRATA);
+			for (int h = 0; h < NUM_STRATA; h++)
+				alloc[h] = { h, st.stratumAlloc[h].get() };
+			strataPick.build(alloc);
+		};
+		if (strata && st.all.get() % REALLOCATE_EVERY != 0)
+			rebuildStrataPick();
+		//One checker for all the samples of the thread: prepare and checkConditions reset what a sample leaves behind, and
+		//its two SF positions are too big to construct per sample
+		LegalChecker lc;
+		lc.init(&lp, tnum);
+
+		while (st.all.get() < threadRuns && !stop.load(std::memory_order_relaxed))
+		{
+			checkpoint.poll(tnum, st, lp);
+
+			int stratum = -1;
+			double stratumMult = 1.0;			//W_h / p_h
+			uint64_t stratumStart = 0;
+			if (strata)
+			{
+				if (st.all.get() % REALLOCATE_EVERY == 0)
 				{
-					auto totalGood = vectorSum(legal);
-					auto totalGoodRestricted = vectorSum(legalRestricted);
-					auto totalAny = vectorSum(all);
-					std::chrono::duration<double> elapsedSeconds = std::chrono::steady_clock::now() - start;
-					cout << "Per second: " << totalAny / elapsedSeconds.count();
-
-					if (sampleType == ESampleType::VERY_RESTRICTED)
-						cout << "  legal_very_restricted: " << totalGoodRestricted << " / all: " << totalAny << "  estimate restricted: "
-						<< (double)totalGoodRestricted / totalAny * totalPossibilities << endl;
-
-					if (sampleType == ESampleType::RESTRICTED || sampleType == ESampleType::WB_RESTRICTED)
-						cout << "  legal_restricted: " << totalGoodRestricted << " / all: " << totalAny << "  estimate restricted: "
-						<< (double)totalGoodRestricted / totalAny * totalPossibilities << endl;
-
-					if (sampleType == ESampleType::PIECES_WB || sampleType == ESampleType::PIECES)
-						cout << "  legal: " << totalGood << " / all: " << totalAny << "  fraction legal: "
-						<< (double)totalGood / totalAny << "  estimate all: " << (double)totalGood / totalAny * totalPossibilities << endl;
-					if (tnum % 8 == 0)
-					{
-						cout << "king squares ";
-						for (int q = 0; q < 64; q++)
-							cout << vectorSum(kingSquares[q]) << " ";
-						cout << endl;
-						for (int q = 2; q <= 32; q++)
-						{
-							int64_t s = 0;
-							for (int t = 0; t < nthreads; t++)
-								s += byCount[t][q];
-							int64_t sRestricted = 0;
-							for (int t = 0; t < nthreads; t++)
-								sRestricted += byCountRestricted[t][q];
-							cout << q << " pieces:   ";
-
-							if (sampleType == ESampleType::PIECES_WB || sampleType == ESampleType::PIECES)
-								cout << "legal = " << s << endl;
-							else if (sampleType == ESampleType::RESTRICTED)
-								cout << "legal restricted = " << sRestricted << endl;
-							else
-								cout << "legal very restricted = " << sRestricted << endl;
-						}
-
-						for (Piece p = W_PAWN; p <= B_KING; ++p)
-						{
-							string s = color_of(p) ? "White " : "Black ";
-							auto pt = type_of(p);
-							if (pt == PAWN || pt == BISHOP || pt == KNIGHT || pt == ROOK || pt == QUEEN)
-							{
-								if (pt == PAWN)
-									s += "pawn";
-								else if (pt == BISHOP)
-									s += "bishop";
-								else if (pt == KNIGHT)
-									s += "knight";
-								else if (pt == ROOK)
-									s += "rook";
-								else if (pt == QUEEN)
-									s += "queen";
-								s += "   ";
-								for (int q = 0; q < 16; q++)
-								{
-									int64_t sum = 0;
-									for (int t = 0; t < nthreads; t++)
-										sum += pieceCountsByThread[t][int(p)][q];
-									s += std::to_string(sum) + " ";
-								}
-								cout << s << endl;
-							}
-						}
-
-						int c = 0;
-						for (const auto& open : openingsToCheck)
-						{
-							auto numLegal = vectorSum(legalOpeningsCount[c]);
-							cout << open.name << ":  legal = " << numLegal << "  estimate = " << (double)numLegal / totalAny * totalPossibilities << endl;
-							c++;
-						}
-
-					}
+					const auto alloc = strata->allocation(strataTotals([&](const EstimateStats& s) { return &s == &st; }), double(st.legalHits.get()));
+					for (int h = 0; h < NUM_STRATA; h++)
+						st.stratumAlloc[h].set(alloc[h]);
+					rebuildStrataPick();
 				}
+				stratum = lp.pickAlias(strataPick);
+				stratumMult = strata->weight(stratum) / st.stratumAlloc[stratum].get();
+				lc.setStratum(stratum);
+				stratumStart = cycleCount();
+			}
+			const int64_t sampleIndex = st.all.get() * nthreads + tnum;
+			if (lp.reproducible)
+				lp.beginIndexedSample(tnum, uint64_t(sampleIndex));
+
+			countSample<sampleType>(lc, lp, st, stratum, stratumMult);
+
+			if (strata)
+			{
+				st.stratumSamples[stratum].add(1);
+				st.stratumCycles[stratum].add(double(cycleCount() - stratumStart));
 			}
 		}
 	}
+
+	done = true;
+	reporter.join();
+	report();
+	if (!checkpointFile.empty())
+	{
+		checkpoint.collectStopped(stats, lp);
+		if (checkpoint.save(checkpointFile, sampleType, lp.profilesName(), lp.shard, lp.reproducible, strata != nullptr))
+			cout << "Checkpoint saved to " << checkpointFile << endl;
+	}
 }
 
 
@@ -401,3 +812,68 @@ template void Runner::posEstimate<ESampleType::PIECES_WB>(int argc, char* argv[]
 template void Runner::posEstimate<ESampleType::RESTRICTED>(int argc, char* argv[]);
 template void Runner::posEstimate<ESampleType::VERY_RESTRICTED>(int argc, char* argv[]);
 template void Runner::posEstimate<ESampleType::WB_RESTRICTED>(int argc, char* argv[]);
+
+template void Runner::countSample<ESampleType::PIECES>(LegalChecker& lc, const LegalParams& lp, EstimateStats& st, int stratum, double stratumMult) const;
+template void Runner::countSample<ESampleType::PIECES_WB>(LegalChecker& lc, const LegalParams& lp, EstimateStats& st, int stratum, double stratumMult) const;
+template void Runner::countSample<ESampleType::RESTRICTED>(LegalChecker& lc, const LegalParams& lp, EstimateStats& st, int stratum, double stratumMult) const;
+template void Runner::countSample<ESampleType::VERY_RESTRICTED>(LegalChecker& lc, const LegalParams& lp, EstimateStats& st, int stratum, double stratumMult) const;
+template void Runner::countSample<ESampleType::WB_RESTRICTED>(LegalChecker& lc, const LegalParams& lp, EstimateStats& st, int stratum, double stratumMult) const;
+
+
+//merge shard1.txt shard2.txt ... [--out merged.txt]: one estimate from the --counts files of several runs
+void Runner::merge(int argc, char* argv[])
+{
+	const string outFile = optionValue(argc, argv, "--out");
+	EstimateCounts total;
+	vector<int> shardsSeen;
+	for (int q = 2; q < argc; q++)
+	{
+		const string arg = argv[q];
+		if (arg == "--out")
+		{
+			q++;
+			continue;
+		}
+
+		EstimateCounts ec;
+		if (!ec.load(arg))
+			return;
+		//The random streams only depend on the shard, so the same shard twice means the same samples counted twice
+		if (std::find(shardsSeen.begin(), shardsSeen.end(), ec.shard) != shardsSeen.end())
+		{
+			cout << "Shard " << ec.shard << " appears more than once (" << arg << "), its samples would be counted twice" << endl;
+			return;
+		}
+		if (!total.add(ec))
+		{
+			cout << arg << " is from a different kind of estimate (" << ec.sampleType << " " << ec.profile << ")" << endl;
+			return;
+		}
+		shardsSeen.push_back(ec.shard);
+
+		auto [est, se] = ec.estimate(ec.legal, ec.legalSq);
+		cout << arg << "  shard " << ec.shard << "/" << ec.shards << "  samples: " << ec.samples << "  estimate: " << est << " +- " << se << endl;
+	}
+
+	if (total.samples == 0)
+	{
+		cout << "Usage: ChessCounter merge counts1.txt counts2.txt ... [--out merged.txt]" << endl;
+		return;
+	}
+
+	auto [est, se] = total.estimate(total.legal, total.legalSq);
+	auto [estR, seR] = total.estimate(total.legalRestricted, total.legalRestrictedSq);
+	cout << endl << total.sampleType << " merged from " << shardsSeen.size() << " files, " << total.samples << " samples" << endl;
+	cout << "legal: " << total.legal << "  estimate all: " << formatEstimate({ est, se }) << " (" << 100 * se / std::max(est, 1.0) << "%)" << endl;
+	cout << "legal_restricted: " << total.legalRestricted << "  estimate restricted: " << formatEstimate({ estR, seR }) << endl;
+	for (int q = 2; q <= 32; q++)
+		cout << q << " pieces:   legal = " << formatEstimate(total.estimate(total.byCount[q], total.byCountSq[q]))
+			<< "  legal restricted = " << formatEstimate(total.estimate(total.byCountRestricted[q], total.byCountRestrictedSq[q])) << endl;
+	for (size_t c = 0; c < total.openings.size(); c++)
+		cout << total.openingNames[c] << ":  estimate = " << formatEstimate(total.estimate(total.openings[c], total.openingsSq[c])) << endl;
+	for (size_t c = 0; c < total.profiles.size(); c++)
+		cout << "Profile " << total.profileNames[c] << ":  estimate = " << formatEstimate(total.estimate(total.profiles[c], total.profilesSq[c])) << endl;
+
+	if (!outFile.empty() && total.save(outFile))
+		cout << "Saved " << outFile << endl;
+}
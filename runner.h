@@ -11,6 +11,8 @@
 #include "OpeningLimit.h"
 #include "LegalChecker.h"
 
+struct EstimateStats;
+
 
 class Runner
 {
@@ -18,10 +20,23 @@ private:
 	std::vector<OpeningLimit> openingsToCheck;
 
 public:
-	void saveFile(std::string fname, const std::vector<std::string>& v);
 	void init();
-	void generateFens(int argc, char* argv[], std::string fname);
+	void generateFens(int argc, char* argv[]);
+	void positionsToFen(int argc, char* argv[]);
+	void revalidate(int argc, char* argv[]);
+	void replay(int argc, char* argv[]);
+	void mateSearch(int argc, char* argv[]);
 	template<ESampleType sampleType>
 	void posEstimate(int argc, char* argv[]);
+	template<ESampleType sampleType>
+	void countSample(LegalChecker& lc, const LegalParams& lp, EstimateStats& st, int stratum, double stratumMult) const;
+	void benchSampler(int argc, char* argv[]);
+	void benchRandom(int argc, char* argv[]);
+	void benchLegal(int argc, char* argv[]);
+	void benchCodec(int argc, char* argv[]);
+	void benchMate(int argc, char* argv[]);
+	[[nodiscard]] bool benchCounter(int argc, char* argv[]);
+	void checkSymmetry(int argc, char* argv[]);
+	void merge(int argc, char* argv[]);
 };
 